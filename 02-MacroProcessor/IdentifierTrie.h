@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Names indexed character by character, so that an identifier can be matched
+// while it's being read, without collecting it first. The children of a node
+// are kept in a list sorted by their character, except for the first
+// character, which is looked up directly.
+template <typename T>
+class IdentifierTrie
+{
+public:
+    using Node = std::uint32_t;
+
+    // Returned by Next when no name continues with the character.
+    static constexpr Node NoNode = ~Node(0);
+
+    IdentifierTrie()
+        : m_nodes(1)
+    {
+        m_firstChars.fill(NoNode);
+    }
+
+    // The node of the empty prefix, where every identifier starts.
+    Node Root() const
+    {
+        return 0;
+    }
+
+    Node Next(Node node, char ch) const
+    {
+        unsigned char label = ch;
+        if (node == Root()) return m_firstChars[label];
+
+        Node child = m_nodes[node].FirstChild;
+        while (child != NoNode && m_nodes[child].Label < label) child = m_nodes[child].NextSibling;
+        return child != NoNode && m_nodes[child].Label == label ? child : NoNode;
+    }
+
+    // The value of the name ending at the node, null if the node is only a
+    // prefix of longer names or if it's NoNode.
+    T* Value(Node node) const
+    {
+        return node != NoNode ? m_nodes[node].Value : nullptr;
+    }
+
+    // The characters leading to the node.
+    std::string_view Prefix(Node node) const
+    {
+        return m_nodes[node].Name.substr(0, m_nodes[node].Depth);
+    }
+
+    T* Find(std::string_view name) const
+    {
+        Node node = Root();
+        for (std::size_t i = 0; i < name.size() && node != NoNode; ++i) node = Next(node, name[i]);
+        return Value(node);
+    }
+
+    // Adds the name or replaces its value. The name has to stay valid for the
+    // lifetime of the trie, as the nodes refer to it.
+    void Insert(std::string_view name, T* value)
+    {
+        Node node = Root();
+        for (std::size_t depth = 0; depth < name.size(); ++depth)
+        {
+            Node next = Next(node, name[depth]);
+            if (next == NoNode) next = addChild(node, name, depth);
+            node = next;
+        }
+
+        m_nodes[node].Value = value;
+    }
+
+private:
+    struct TrieNode
+    {
+        Node             FirstChild  = NoNode;
+        Node             NextSibling = NoNode;
+        unsigned char    Label       = 0;
+        std::uint32_t    Depth       = 0;
+        // Some name passing through the node, the prefix is taken from it.
+        std::string_view Name;
+        T*               Value       = nullptr;
+    };
+
+    Node addChild(Node parent, std::string_view name, std::size_t depth)
+    {
+        Node child = (Node)m_nodes.size();
+        unsigned char label = name[depth];
+
+        TrieNode node;
+        node.Label = label;
+        node.Depth = (std::uint32_t)depth + 1;
+        node.Name = name;
+
+        if (parent == Root())
+        {
+            m_firstChars[label] = child;
+        }
+        else
+        {
+            Node* link = &m_nodes[parent].FirstChild;
+            while (*link != NoNode && m_nodes[*link].Label < label) link = &m_nodes[*link].NextSibling;
+            node.NextSibling = *link;
+            *link = child;
+        }
+
+        m_nodes.push_back(node);
+        return child;
+    }
+
+    std::vector<TrieNode>       m_nodes;
+    std::array<Node, 256>       m_firstChars;
+};
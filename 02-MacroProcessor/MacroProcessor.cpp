@@ -1,24 +1,119 @@
 #include "MacroProcessor.h"
 
-std::size_t replace_all(std::string& inout, std::string_view what, std::string_view with)
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <thread>
+
+namespace
 {
-    std::size_t count{};
-    for (std::string::size_type pos{};
-         inout.npos != (pos = inout.find(what.data(), pos, what.length()));
-         pos += with.length(), ++count) {
-        inout.replace(pos, what.length(), with.data(), with.length());
+    // Inputs are only split into chunks of at least this size, a few per job.
+    constexpr std::size_t MinChunkSize = 1 << 16;
+    constexpr std::size_t ChunksPerJob = 4;
+
+    struct Definition
+    {
+        // The '#' starting the definition and the first character after it
+        // that is processed as text again.
+        std::size_t Begin;
+        std::size_t End;
+        std::string Identifier;
+        std::string Body;
+    };
+
+    std::string withoutHashes(std::string_view text)
+    {
+        std::string result;
+        for (char ch : text)
+        {
+            if (ch != '#') result.push_back(ch);
+        }
+        return result;
+    }
+
+    // Finds the macro definitions in the same places as the state machine,
+    // without processing the text between them. Returns where the input stops
+    // being safe to split, which is the start of the first definition that
+    // fails or isn't finished by the end of the input.
+    std::size_t findDefinitions(std::string_view input, std::vector<Definition>& definitions)
+    {
+        // A definition starts with a '#' after whitespace, or with a '#' right
+        // where the previous definition left the state machine in Begin.
+        auto findStart = [input](std::size_t from)
+        {
+            std::size_t pos = input.find('#', from);
+            while (pos != input.npos && !std::isspace(input[pos - 1])) pos = input.find('#', pos + 1);
+            return pos;
+        };
+
+        std::size_t textBegin = 0;
+        while (textBegin < input.size())
+        {
+            std::size_t begin = input[textBegin] == '#' ? textBegin : findStart(textBegin + 1);
+            if (begin == input.npos) break;
+
+            std::size_t bodyBegin = begin + 1;
+            while (bodyBegin < input.size() && !std::isspace(input[bodyBegin])) ++bodyBegin;
+
+            std::size_t end = bodyBegin < input.size() ? findStart(bodyBegin + 1) : input.npos;
+            if (end == input.npos || end + 1 >= input.size() || std::isalpha(input[end + 1])) return begin;
+
+            Definition definition{ begin, end + 2, withoutHashes(input.substr(begin + 1, bodyBegin - begin - 1)), withoutHashes(input.substr(bodyBegin, end - bodyBegin)) };
+            if (definition.Identifier.empty()) return begin;
+
+            definitions.push_back(std::move(definition));
+            textBegin = end + 2;
+        }
+
+        return input.size();
+    }
+
+    // Splits the input right after newlines that are processed as text. The
+    // state machine is then always propagating text with the newline as the
+    // previous character at the start of a chunk.
+    std::vector<std::size_t> findChunkBounds(std::string_view input, const std::vector<Definition>& definitions, std::size_t safeEnd, std::size_t chunks)
+    {
+        std::vector<std::size_t> bounds{ 0 };
+        auto definition = definitions.begin();
+        for (std::size_t chunk = 1; chunk < chunks; ++chunk)
+        {
+            std::size_t pos = input.find('\n', std::max(bounds.back(), safeEnd * chunk / chunks));
+            while (pos < safeEnd)
+            {
+                while (definition != definitions.end() && definition->End <= pos) ++definition;
+                if (definition == definitions.end() || definition->Begin > pos) break;
+
+                pos = input.find('\n', definition->End);
+            }
+            if (pos >= safeEnd || pos + 1 >= input.size()) break;
+
+            bounds.push_back(pos + 1);
+        }
+
+        bounds.push_back(input.size());
+        return bounds;
     }
-    return count;
 }
 
 MacroProcessor::MacroProcessor(std::ostream& output)
-    : m_output(output)
+    : m_output(output), m_sink(output)
 {
 }
 
 void MacroProcessor::AddMacro(const std::string& identifier, const std::string& body)
 {
-    m_macros[identifier] = body;
+    defineMacro(identifier, body);
+}
+
+void MacroProcessor::AddMacros(const MacroProcessor& other)
+{
+    for (auto& [identifier, macro] : other.m_macros) defineMacro(identifier, *macro.Body);
+}
+
+void MacroProcessor::SetOutputDescriptor(int fd)
+{
+    m_sink.SetDescriptor(fd);
 }
 
 bool MacroProcessor::Push(char ch)
@@ -61,6 +156,56 @@ bool MacroProcessor::Push(char ch)
     return true;;
 }
 
+bool MacroProcessor::Push(std::string_view chunk)
+{
+    std::size_t pos = 0;
+    while (pos < chunk.size())
+    {
+        // Characters that don't change the state only move through m_prevChar,
+        // so a run of them is the previous character followed by all of the
+        // run but its last character, which becomes the previous one.
+        std::size_t end = pos;
+        switch(m_state)
+        {
+            case ProcessorState::PropagateNonIdentifier:
+                while (end < chunk.size() && !std::isalpha(chunk[end]) && chunk[end] != '#') ++end;
+                if (end == pos) break;
+
+                write(m_prevChar);
+                writeInput(chunk.substr(pos, end - pos - 1));
+                break;
+            case ProcessorState::ReadingIdentifier:
+                while (end < chunk.size() && std::isalnum(chunk[end])) ++end;
+                if (end == pos) break;
+
+                matchIdentifier(std::string_view(&m_prevChar, 1));
+                matchIdentifier(chunk.substr(pos, end - pos - 1));
+                break;
+            case ProcessorState::ReadingMacroBody:
+                while (end < chunk.size() && chunk[end] != '#') ++end;
+                if (end == pos) break;
+
+                if (m_prevChar != '#') m_macroBodyBuffer.append(1, m_prevChar);
+                m_macroBodyBuffer.append(chunk.data() + pos, end - pos - 1);
+                break;
+            default:
+                break;
+        }
+
+        if (end != pos)
+        {
+            m_prevChar = chunk[end - 1];
+            pos = end;
+        }
+        else if (!Push(chunk[pos++]))
+        {
+            return false;
+        }
+    }
+
+    return m_state != ProcessorState::Error;
+}
+
 bool MacroProcessor::operator<<(char ch)
 {
     return Push(ch);
@@ -68,12 +213,117 @@ bool MacroProcessor::operator<<(char ch)
 
 void MacroProcessor::Finish()
 {
-    if (!(m_state == ProcessorState::Error)) m_output << m_identifierBuffer << m_prevChar;
+    if (m_state == ProcessorState::Error)
+    {
+        flushOutput();
+        return;
+    }
+
+    // An identifier that is still a possible macro name hasn't been written yet.
+    if (m_state == ProcessorState::ReadingIdentifier && m_identifierNode != MacroTrie::NoNode)
+    {
+        write(m_macroNames.Prefix(m_identifierNode));
+    }
+    write(m_macroNameBuffer);
+    write(m_prevChar);
+    flushOutput();
+}
+
+bool MacroProcessor::Process(std::string_view input, std::size_t jobs)
+{
+    std::vector<Definition> definitions;
+    std::vector<std::size_t> bounds{ 0, input.size() };
+    if (jobs > 1)
+    {
+        std::size_t safeEnd = findDefinitions(input, definitions);
+        bounds = findChunkBounds(input, definitions, safeEnd, std::min(jobs * ChunksPerJob, input.size() / MinChunkSize));
+    }
+
+    // The input outlives the processing, so the output may refer to it.
+    std::size_t chunks = bounds.size() - 1;
+    if (chunks <= 1)
+    {
+        m_inputPersistent = true;
+        bool processed = Push(input);
+        Finish();
+        m_inputPersistent = false;
+        return processed;
+    }
+
+    // Every chunk gets a processor of its own with the macros defined in front
+    // of it. It holds its output until all chunks before it are written out.
+    // Chunks after one that failed aren't needed.
+    std::vector<std::unique_ptr<MacroProcessor>> processors(chunks);
+    std::vector<std::promise<bool>> results(chunks);
+    std::atomic<std::size_t> nextChunk{ 0 };
+    std::atomic<std::size_t> failedChunk{ chunks };
+
+    auto work = [&]()
+    {
+        for (std::size_t chunk; (chunk = nextChunk++) < chunks;)
+        {
+            if (chunk > failedChunk)
+            {
+                results[chunk].set_value(false);
+                continue;
+            }
+
+            processors[chunk] = std::make_unique<MacroProcessor>(m_output);
+            MacroProcessor& processor = *processors[chunk];
+            processor.SetOutputDescriptor(m_sink.Descriptor());
+            processor.m_inputPersistent = true;
+            processor.m_holdOutput = true;
+
+            processor.AddMacros(*this);
+            for (auto& definition : definitions)
+            {
+                if (definition.End > bounds[chunk]) break;
+                processor.AddMacro(definition.Identifier, definition.Body);
+            }
+
+            if (chunk != 0)
+            {
+                processor.m_state = ProcessorState::PropagateNonIdentifier;
+                processor.m_prevChar = input[bounds[chunk] - 1];
+            }
+
+            bool processed = processor.Push(input.substr(bounds[chunk], bounds[chunk + 1] - bounds[chunk]));
+            if (chunk + 1 == chunks) processor.Finish();
+
+            if (!processed)
+            {
+                std::size_t failed = failedChunk;
+                while (chunk < failed && !failedChunk.compare_exchange_weak(failed, chunk)) {}
+            }
+            results[chunk].set_value(processed);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < std::min(jobs, chunks); ++i) workers.emplace_back(work);
+
+    bool processed = true;
+    for (std::size_t chunk = 0; chunk < chunks && processed; ++chunk)
+    {
+        processed = results[chunk].get_future().get();
+        processors[chunk]->m_holdOutput = false;
+        processors[chunk]->flushOutput();
+        if (!processed) m_message = processors[chunk]->GetMessage();
+        processors[chunk].reset();
+    }
+
+    for (auto& worker : workers) worker.join();
+    return processed;
+}
+
+const std::string& MacroProcessor::GetMessage() const
+{
+    return m_message;
 }
 
 void MacroProcessor::propagateNonIdentifier(char ch)
 {
-    m_output << m_prevChar;
+    write(m_prevChar);
 
     if (std::isalpha(ch))
     {
@@ -89,19 +339,26 @@ void MacroProcessor::propagateNonIdentifier(char ch)
 
 void MacroProcessor::readIdentifier(char ch)
 {
-    m_identifierBuffer.append(1, m_prevChar);
+    matchIdentifier(std::string_view(&m_prevChar, 1));
 
     if (!std::isalnum(ch))
     {
-        if (m_macros.find(m_identifierBuffer) != m_macros.end())
+        if (Macro* macro = m_macroNames.Value(m_identifierNode))
         {
-            m_output << m_macros[m_identifierBuffer];
+            if (!resolveMacro(*macro))
+            {
+                write("Error\n");
+                m_state = ProcessorState::Error;
+                return;
+            }
+
+            writeMacro(*macro);
         }
-        else 
+        else if (m_identifierNode != MacroTrie::NoNode)
         {
-            m_output << m_identifierBuffer;
+            write(m_macroNames.Prefix(m_identifierNode));
         }
-        m_identifierBuffer = "";
+        m_identifierNode = m_macroNames.Root();
 
         if (ch == '#' && std::isspace(m_prevChar))
         {
@@ -116,13 +373,84 @@ void MacroProcessor::readIdentifier(char ch)
     m_prevChar = ch;
 }
 
+// Follows the characters of the identifier being read in the trie of macro
+// names. Once no macro name starts with the identifier, it's written out and
+// its remaining characters are passed straight through.
+void MacroProcessor::matchIdentifier(std::string_view chars)
+{
+    std::size_t i = 0;
+    while (i < chars.size() && m_identifierNode != MacroTrie::NoNode)
+    {
+        MacroTrie::Node next = m_macroNames.Next(m_identifierNode, chars[i]);
+        if (next == MacroTrie::NoNode)
+        {
+            write(m_macroNames.Prefix(m_identifierNode));
+            m_identifierNode = MacroTrie::NoNode;
+            break;
+        }
+
+        m_identifierNode = next;
+        ++i;
+    }
+
+    if (m_identifierNode == MacroTrie::NoNode) writeInput(chars.substr(i));
+}
+
+void MacroProcessor::write(char ch)
+{
+    m_sink.Write(ch);
+    if (m_sink.Full()) flushOutput();
+}
+
+void MacroProcessor::write(std::string_view text)
+{
+    m_sink.Write(text);
+    if (m_sink.Full()) flushOutput();
+}
+
+// Text taken from the pushed input, which is only referenced if it outlives
+// the processing.
+void MacroProcessor::writeInput(std::string_view text)
+{
+    if (m_inputPersistent) m_sink.Reference(text);
+    else m_sink.Write(text);
+    if (m_sink.Full()) flushOutput();
+}
+
+// Writes the expansion piece by piece, referring to the bodies of the macros
+// instead of copying them.
+void MacroProcessor::writeMacro(const Macro& macro)
+{
+    for (const ExpansionPiece& piece : macro.Expansion)
+    {
+        if (piece.Nested)
+        {
+            writeMacro(*piece.Nested);
+            continue;
+        }
+
+        m_sink.Reference(piece.Text);
+        if (m_sink.Full()) flushOutput();
+    }
+}
+
+// Bodies replaced since the last flush may still be referenced by the output,
+// they're only released once it has been written.
+void MacroProcessor::flushOutput()
+{
+    if (m_holdOutput) return;
+
+    m_sink.Flush();
+    m_retiredBodies.clear();
+}
+
 void MacroProcessor::readMacroDefinition(char ch)
 {
     if (m_prevChar != '#')
     {
         if (m_state == ProcessorState::ReadingMacroIdentifier)
         {
-            m_identifierBuffer.append(1, m_prevChar);
+            m_macroNameBuffer.append(1, m_prevChar);
         }
         else
         {
@@ -136,9 +464,10 @@ void MacroProcessor::readMacroDefinition(char ch)
     }
     else if (ch == '#' && std::isspace(m_prevChar) && m_state == ProcessorState::ReadingMacroBody)
     {
-        if (m_identifierBuffer == "")
+        if (m_macroNameBuffer == "")
         {
-            m_output << " Error\n";
+            m_message = "macro definition without a name";
+            write(" Error\n");
             m_state = ProcessorState::Error;
             return;
         }
@@ -149,7 +478,8 @@ void MacroProcessor::readMacroDefinition(char ch)
     {
         if (m_prevChar == '#' && std::isalpha(ch))
         {
-            m_output << "Error\n";
+            m_message = "macro definition followed by a letter";
+            write("Error\n");
             m_state = ProcessorState::Error;
         }
         else
@@ -157,24 +487,143 @@ void MacroProcessor::readMacroDefinition(char ch)
             m_state = ProcessorState::Begin;
         }
 
-        m_macros[m_identifierBuffer] = m_macroBodyBuffer;
-        m_identifierBuffer = "";
+        defineMacro(m_macroNameBuffer, m_macroBodyBuffer);
+        m_macroNameBuffer = "";
         m_macroBodyBuffer = "";
-        unrollMacros();
     }
 
     m_prevChar = ch;
 }
 
-void MacroProcessor::unrollMacros()
+// Splits the body into identifiers and the text between them. Which of the
+// identifiers are macros is only decided when the macro gets expanded.
+void MacroProcessor::defineMacro(const std::string& identifier, const std::string& body)
+{
+    auto [entry, added] = m_macros.try_emplace(identifier);
+    Macro& macro = entry->second;
+    if (added)
+    {
+        macro.Name = entry->first;
+        m_macroNames.Insert(macro.Name, &macro);
+    }
+    for (std::string_view reference : macro.References)
+    {
+        std::vector<Macro*>& dependents = m_dependents[std::string(reference)];
+        dependents.erase(std::find(dependents.begin(), dependents.end(), &macro));
+    }
+
+    if (macro.Body) m_retiredBodies.push_back(std::move(macro.Body));
+    macro.Body = std::make_unique<const std::string>(body);
+    macro.Tokens.clear();
+    macro.References.clear();
+
+    std::string_view text = *macro.Body;
+    std::size_t pos = 0;
+    while (pos < text.size())
+    {
+        std::size_t end = pos + 1;
+        bool isIdentifier = std::isalpha(text[pos]);
+        if (isIdentifier)
+        {
+            while (end < text.size() && std::isalnum(text[end])) ++end;
+        }
+        else
+        {
+            while (end < text.size() && !std::isalpha(text[end])) ++end;
+        }
+
+        macro.Tokens.push_back({ text.substr(pos, end - pos), isIdentifier });
+        if (isIdentifier) macro.References.push_back(text.substr(pos, end - pos));
+        pos = end;
+    }
+
+    std::sort(macro.References.begin(), macro.References.end());
+    macro.References.erase(std::unique(macro.References.begin(), macro.References.end()), macro.References.end());
+    for (std::string_view reference : macro.References) m_dependents[std::string(reference)].push_back(&macro);
+
+    invalidateDependents(macro);
+}
+
+// Marks the expansion of the macro as stale, along with the ones using its
+// name and the ones using those in turn. A macro is only resolved after the
+// macros it uses, so the walk can stop at one that isn't resolved.
+void MacroProcessor::invalidateDependents(Macro& macro)
+{
+    if (macro.Resolved)
+    {
+        macro.Resolved = false;
+        macro.Expansion.clear();
+    }
+
+    std::vector<std::string_view> pending{ macro.Name };
+    while (!pending.empty())
+    {
+        auto entry = m_dependents.find(std::string(pending.back()));
+        pending.pop_back();
+        if (entry == m_dependents.end()) continue;
+
+        for (Macro* dependent : entry->second)
+        {
+            if (!dependent->Resolved) continue;
+
+            dependent->Resolved = false;
+            dependent->Expansion.clear();
+            pending.push_back(dependent->Name);
+        }
+    }
+}
+
+// Resolves which identifiers of the body are macros, unless that's already
+// done since they were last defined, and makes sure the macros it uses are
+// resolved too. Returns false if the macro refers to itself, directly or
+// through other macros.
+bool MacroProcessor::resolveMacro(Macro& macro)
 {
-    for (auto&[identifier, body] : m_macros)
+    if (macro.Resolved) return true;
+
+    if (macro.Expanding)
     {
-        for (auto[unrolling_identifier, unrolling_body] : m_macros)
+        m_message = "recursive macro: ";
+        auto first = std::find(m_expansionStack.begin(), m_expansionStack.end(), &macro);
+        for (auto it = first; it != m_expansionStack.end(); ++it) m_message.append((*it)->Name).append(" -> ");
+        m_message.append(macro.Name);
+        return false;
+    }
+
+    macro.Expanding = true;
+    m_expansionStack.push_back(&macro);
+
+    // Consecutive tokens that aren't macros are adjacent in the body, so they
+    // are merged into a single piece.
+    std::vector<ExpansionPiece> expansion;
+    for (const BodyToken& token : macro.Tokens)
+    {
+        Macro* other = token.IsIdentifier ? m_macroNames.Find(token.Text) : nullptr;
+        if (other)
         {
-            if (identifier == unrolling_identifier) continue;
+            if (!resolveMacro(*other))
+            {
+                macro.Expanding = false;
+                m_expansionStack.pop_back();
+                return false;
+            }
 
-            replace_all(body, unrolling_identifier, unrolling_body);
+            expansion.push_back({ {}, other });
+        }
+        else if (!expansion.empty() && !expansion.back().Nested)
+        {
+            std::string_view& text = expansion.back().Text;
+            text = std::string_view(text.data(), text.size() + token.Text.size());
+        }
+        else
+        {
+            expansion.push_back({ token.Text, nullptr });
         }
     }
+
+    macro.Expanding = false;
+    m_expansionStack.pop_back();
+    macro.Expansion = std::move(expansion);
+    macro.Resolved = true;
+    return true;
 }
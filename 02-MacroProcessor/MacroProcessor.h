@@ -1,8 +1,14 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <ostream>
+#include <vector>
+
+#include "IdentifierTrie.h"
+#include "OutputSink.h"
 
 // The way this class behaves is this:
 // 1) the previous character is processed
@@ -24,24 +30,104 @@ class MacroProcessor
 public:
     MacroProcessor(std::ostream& output);
     void AddMacro(const std::string& identifier, const std::string& body);
+    // Adds all macros defined in the other processor, which isn't modified,
+    // so several processors can take their macros from the same one at once.
+    void AddMacros(const MacroProcessor& other);
+
+    // Writes the output directly to the file descriptor with writev instead of
+    // the stream. The descriptor isn't closed.
+    void SetOutputDescriptor(int fd);
 
     // Returns false if there was an error with processing the character.
     bool Push(char ch);
+    // Same as pushing the characters one by one, but runs of plain text,
+    // identifier characters and macro body are handled in bulk.
+    bool Push(std::string_view chunk);
     bool operator<<(char ch);
+    // Writes out the rest of the output, which is buffered until then.
     void Finish();
 
+    // Processes the whole input and finishes the output, the same as pushing
+    // the input and calling Finish. The macro definitions are found first,
+    // then the input is split between them and the chunks are expanded on up
+    // to the given number of threads, each with the macros defined in front
+    // of it. With a single thread the input is pushed as it is. Must be called
+    // before anything else is pushed.
+    bool Process(std::string_view input, std::size_t jobs);
+
+    // Describes the error that stopped the processing, empty if there was none.
+    const std::string& GetMessage() const;
+
 private:
 
+    // A piece of a macro body, either plain text or an identifier that may
+    // refer to another macro. It points into the body of its macro.
+    struct BodyToken
+    {
+        std::string_view Text;
+        bool             IsIdentifier;
+    };
+
+    struct Macro;
+
+    // A piece of an expansion, either text of a body or a nested macro.
+    struct ExpansionPiece
+    {
+        std::string_view Text;
+        const Macro*     Nested;
+    };
+
+    // The body is split into tokens when the macro is defined. The references
+    // to other macros are resolved on the first use, the expansion is kept
+    // until one of the identifiers it depends on gets defined, directly or
+    // through the macros it uses. It's never flattened into a string, the
+    // output refers to the bodies directly.
+    struct Macro
+    {
+        std::string_view                    Name;
+        std::unique_ptr<const std::string>  Body;
+        std::vector<BodyToken>              Tokens;
+        // The distinct identifiers of the body, whether they're macros or not.
+        std::vector<std::string_view>       References;
+        std::vector<ExpansionPiece>         Expansion;
+        bool                                Resolved            = false;
+        bool                                Expanding           = false;
+    };
+
     void propagateNonIdentifier(char ch);
     void readIdentifier(char ch);
+    void matchIdentifier(std::string_view chars);
     void readMacroDefinition(char ch);
-    void unrollMacros();
-
-    std::ostream&                                 m_output;
-    std::string                                   m_identifierBuffer = "";
-    std::string                                   m_macroBodyBuffer  = "";
-    char                                          m_prevChar         = ' ';
-    bool                                          m_processedError   = false;
-    ProcessorState                                m_state            = ProcessorState::Begin;
-    std::unordered_map<std::string, std::string>  m_macros;
+    void write(char ch);
+    void write(std::string_view text);
+    void writeInput(std::string_view text);
+    void writeMacro(const Macro& macro);
+    void flushOutput();
+    void defineMacro(const std::string& identifier, const std::string& body);
+    bool resolveMacro(Macro& macro);
+    void invalidateDependents(Macro& macro);
+
+    using MacroTrie = IdentifierTrie<Macro>;
+
+    std::ostream&                            m_output;
+    OutputSink                               m_sink;
+    // Whether pushed text stays valid until the output is flushed.
+    bool                                     m_inputPersistent    = false;
+    // Whether the output is kept until it's flushed from outside.
+    bool                                     m_holdOutput         = false;
+    std::vector<std::unique_ptr<const std::string>> m_retiredBodies;
+    std::string                              m_macroNameBuffer    = "";
+    std::string                              m_macroBodyBuffer    = "";
+    char                                     m_prevChar           = ' ';
+    bool                                     m_processedError     = false;
+    ProcessorState                           m_state              = ProcessorState::Begin;
+    std::unordered_map<std::string, Macro>   m_macros;
+    MacroTrie                                m_macroNames;
+    // Where the identifier being read is in m_macroNames, NoNode once it
+    // can't be a macro name anymore.
+    MacroTrie::Node                          m_identifierNode     = 0;
+    // The macros whose bodies contain each identifier, defined or not.
+    std::unordered_map<std::string, std::vector<Macro*>> m_dependents;
+    std::vector<const Macro*>                m_expansionStack;
+    std::string                              m_message;
 };
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only mapping of a whole regular file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator= (const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if (m_data) munmap(m_data, m_size);
+    }
+
+    // Returns false if the path isn't a regular file or it can't be mapped,
+    // the caller is expected to fall back to reading it as a stream then.
+    bool Open(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat info;
+        bool regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+        if (regular && info.st_size > 0)
+        {
+            void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                m_data = data;
+                m_size = (size_t)info.st_size;
+                madvise(m_data, m_size, MADV_SEQUENTIAL);
+            }
+            else
+            {
+                regular = false;
+            }
+        }
+
+        close(fd);
+        return regular;
+    }
+
+    std::string_view Data() const
+    {
+        return std::string_view(static_cast<const char*>(m_data), m_size);
+    }
+
+private:
+    void* m_data = nullptr;
+    size_t m_size = 0;
+};
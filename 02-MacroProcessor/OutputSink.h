@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Collects the output as a list of segments until it's flushed. Long pieces
+// whose memory stays valid until the flush are referenced in place, short
+// ones are copied into blocks of storage owned by the sink. A flush writes
+// all segments with writev when there is a file descriptor, otherwise one
+// by one to the stream.
+class OutputSink
+{
+public:
+    OutputSink(std::ostream& stream, int fd = -1)
+        : m_stream(stream), m_fd(fd)
+    {
+    }
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator= (const OutputSink&) = delete;
+
+    void SetDescriptor(int fd)
+    {
+        m_fd = fd;
+    }
+
+    int Descriptor() const
+    {
+        return m_fd;
+    }
+
+    void Write(char ch)
+    {
+        Write(std::string_view(&ch, 1));
+    }
+
+    void Write(std::string_view data)
+    {
+        if (data.empty()) return;
+
+        if (m_blocks.empty() || m_blockUsed + data.size() > m_blockSize)
+        {
+            m_blockSize = std::max(BlockSize, data.size());
+            m_blocks.emplace_back(new char[m_blockSize]);
+            m_blockUsed = 0;
+        }
+
+        char* dest = m_blocks.back().get() + m_blockUsed;
+        std::copy(data.begin(), data.end(), dest);
+        m_blockUsed += data.size();
+        m_copiedBytes += data.size();
+        append(dest, data.size());
+    }
+
+    // Appends the data without copying it, unless it's short. It has to stay
+    // valid until the next Flush.
+    void Reference(std::string_view data)
+    {
+        if (data.size() < ReferenceMinLength)
+        {
+            Write(data);
+            return;
+        }
+
+        append(data.data(), data.size());
+    }
+
+    // Whether enough has been collected to be worth a flush.
+    bool Full() const
+    {
+        return m_copiedBytes >= BlockSize || m_segments.size() >= MaxSegments;
+    }
+
+    // Writes out all segments, returns false if a write failed.
+    bool Flush()
+    {
+        bool written = m_fd >= 0 ? writeSegments() : writeToStream();
+
+        // The last block is kept for reuse if it has the usual size.
+        m_segments.clear();
+        if (!m_blocks.empty() && m_blockSize == BlockSize) m_blocks.erase(m_blocks.begin(), m_blocks.end() - 1);
+        else m_blocks.clear();
+        m_blockUsed = 0;
+        m_copiedBytes = 0;
+        return written;
+    }
+
+private:
+    static constexpr std::size_t BlockSize = 1 << 16;
+
+    // Pieces shorter than this are cheaper to copy than to reference.
+    static constexpr std::size_t ReferenceMinLength = 256;
+
+#ifdef IOV_MAX
+    static constexpr std::size_t MaxSegments = IOV_MAX;
+#else
+    static constexpr std::size_t MaxSegments = 16;
+#endif
+
+    // Extends the last segment if the data directly follows it.
+    void append(const char* data, std::size_t length)
+    {
+        if (!m_segments.empty())
+        {
+            iovec& last = m_segments.back();
+            if (static_cast<const char*>(last.iov_base) + last.iov_len == data)
+            {
+                last.iov_len += length;
+                return;
+            }
+        }
+
+        m_segments.push_back({ const_cast<char*>(data), length });
+    }
+
+    bool writeToStream()
+    {
+        for (auto& segment : m_segments) m_stream.write(static_cast<const char*>(segment.iov_base), segment.iov_len);
+        return (bool)m_stream;
+    }
+
+    // Calls writev until all segments are written, resuming after partial writes.
+    bool writeSegments()
+    {
+        std::size_t first = 0;
+        while (first < m_segments.size())
+        {
+            ssize_t written = writev(m_fd, m_segments.data() + first, (int)std::min(m_segments.size() - first, MaxSegments));
+            if (written < 0)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+
+            while (first < m_segments.size() && (std::size_t)written >= m_segments[first].iov_len)
+            {
+                written -= m_segments[first].iov_len;
+                ++first;
+            }
+
+            if (first < m_segments.size())
+            {
+                m_segments[first].iov_base = static_cast<char*>(m_segments[first].iov_base) + written;
+                m_segments[first].iov_len -= written;
+            }
+        }
+
+        return true;
+    }
+
+    std::ostream&                         m_stream;
+    int                                   m_fd;
+    std::vector<iovec>                    m_segments;
+    std::vector<std::unique_ptr<char[]>>  m_blocks;
+    std::size_t                           m_blockSize   = 0;
+    std::size_t                           m_blockUsed   = 0;
+    std::size_t                           m_copiedBytes = 0;
+};
@@ -1,18 +1,206 @@
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "MacroProcessor.h"
+#include "MappedFile.h"
+
+namespace
+{
+    // The contents of an input file, mapped if it's a regular file and read
+    // into memory otherwise.
+    struct InputFile
+    {
+        MappedFile          Mapped;
+        std::string         Contents;
+        std::string_view    Data;
+    };
+
+    bool readInput(const std::string& path, InputFile& file)
+    {
+        if (file.Mapped.Open(path))
+        {
+            file.Data = file.Mapped.Data();
+            return true;
+        }
+
+        std::ifstream stream(path, std::ios::binary);
+        if (!stream) return false;
+
+        file.Contents.assign(std::istreambuf_iterator<char>(stream), {});
+        file.Data = file.Contents;
+        return true;
+    }
+
+    // Expands the file into <file>.out, or into a file of the same name in the
+    // output directory if there is one. Returns what went wrong, empty if
+    // nothing did.
+    std::string processFile(const std::string& path, const MacroProcessor& macros, const std::string& outputDirectory, std::size_t jobs)
+    {
+        InputFile input;
+        if (!readInput(path, input)) return "cannot read the file";
+
+        std::filesystem::path outputPath = path;
+        if (!outputDirectory.empty()) outputPath = std::filesystem::path(outputDirectory) / outputPath.filename();
+        outputPath += ".out";
+
+        int fd = open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) return "cannot write " + outputPath.string() + ": " + std::system_category().message(errno);
 
+        // The output goes to the descriptor, the stream is never written.
+        std::ostream unused(nullptr);
+        MacroProcessor p(unused);
+        p.SetOutputDescriptor(fd);
+        p.AddMacros(macros);
+        p.Process(input.Data, jobs);
+        close(fd);
+        return p.GetMessage();
+    }
+
+    // Processes the files on up to the given number of threads, all of them
+    // starting with the same macros. Returns false if any of them failed.
+    bool processFiles(const std::vector<std::string>& paths, const MacroProcessor& macros, const std::string& outputDirectory, std::size_t jobs)
+    {
+        // Threads left over when there are fewer files go to splitting them.
+        std::size_t fileJobs = std::max<std::size_t>(1, jobs / std::max<std::size_t>(1, paths.size()));
+        std::atomic<std::size_t> nextFile{ 0 };
+        std::atomic<bool> failed{ false };
+        std::mutex errorMutex;
+
+        auto work = [&]()
+        {
+            for (std::size_t file; (file = nextFile++) < paths.size();)
+            {
+                std::string error = processFile(paths[file], macros, outputDirectory, fileJobs);
+                if (error.empty()) continue;
+
+                failed = true;
+                std::lock_guard<std::mutex> lock(errorMutex);
+                std::cerr << paths[file] << ": " << error << std::endl;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (std::size_t i = 1; i < std::min(jobs, paths.size()); ++i) workers.emplace_back(work);
+        work();
+        for (auto& worker : workers) worker.join();
+        return !failed;
+    }
+}
+
+// Usage:
+//   MacroProcessor [-j <jobs>] [-m <macro file>] [<identifier> <body>...]
+//     expands stdin to stdout.
+//   MacroProcessor [-j <jobs>] [-m <macro file>] [-o <directory>] -b <file>...
+//     expands every file into <file>.out, or into the directory.
+// The macros defined in the macro file are predefined for every input, the
+// rest of it is ignored.
 int main(int argc, char ** argv)
 {
+    // Lets std::cout buffer on its own instead of going through stdio.
+    std::ios_base::sync_with_stdio(false);
+
+    // -j <jobs> reads the whole input first and expands it on several
+    // threads, zero meaning all hardware threads. In batch mode the files are
+    // processed concurrently instead.
+    int firstArg = 1;
+    std::size_t jobs = 1;
+    bool parallel = false;
+    bool batch = false;
+    std::string macroFile;
+    std::string outputDirectory;
+    while (firstArg < argc)
+    {
+        std::string option = argv[firstArg];
+        if (option == "-b")
+        {
+            batch = true;
+            ++firstArg;
+            break;
+        }
+        if (firstArg + 1 == argc) break;
+
+        if (option == "-j")
+        {
+            jobs = std::strtoul(argv[firstArg + 1], nullptr, 10);
+            if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+            parallel = true;
+        }
+        else if (option == "-m")
+        {
+            macroFile = argv[firstArg + 1];
+        }
+        else if (option == "-o")
+        {
+            outputDirectory = argv[firstArg + 1];
+        }
+        else
+        {
+            break;
+        }
+        firstArg += 2;
+    }
+
+    // The macro file is expanded like any input, only to collect the macros.
+    std::ostream discarded(nullptr);
+    MacroProcessor macros(discarded);
+    if (!macroFile.empty())
+    {
+        InputFile input;
+        if (!readInput(macroFile, input))
+        {
+            std::cerr << macroFile << ": cannot read the file" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if (!macros.Process(input.Data, 1))
+        {
+            std::cerr << macroFile << ": " << macros.GetMessage() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (batch)
+    {
+        if (!outputDirectory.empty())
+        {
+            std::error_code error;
+            std::filesystem::create_directories(outputDirectory, error);
+            if (error)
+            {
+                std::cerr << outputDirectory << ": " << error.message() << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        std::vector<std::string> paths(argv + firstArg, argv + argc);
+        return processFiles(paths, macros, outputDirectory, jobs) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Nothing else goes to stdout, so the expansion is written with writev
+    // straight to the descriptor.
     MacroProcessor p(std::cout);
+    p.SetOutputDescriptor(STDOUT_FILENO);
+    p.AddMacros(macros);
 
-    if (argc > 1)
+    if (argc > firstArg)
     {
-        std::string identifier = argv[1];
+        std::string identifier = argv[firstArg];
         std::string body = "";
-        for(int i = 2; i < argc; ++i)
+        for(int i = firstArg + 1; i < argc; ++i)
         {
             body.append(argv[i]);
             if (i != argc - 1) body.append(" ");
@@ -20,14 +208,23 @@ int main(int argc, char ** argv)
         p.AddMacro(identifier, body);
     }
 
-    char ch;
-    std::cin.unsetf(std::ios_base::skipws);
-	while (std::cin >> ch)
+    std::vector<char> buffer(1 << 16);
+    std::string input;
+    std::size_t length;
+    while ((length = std::fread(buffer.data(), 1, buffer.size(), stdin)) > 0)
     {
-        if(!(p << ch))
+        if (parallel)
+        {
+            input.append(buffer.data(), length);
+        }
+        else if (!p.Push(std::string_view(buffer.data(), length)))
         {
             break;
         }
     }
-    p.Finish();
-}
\ No newline at end of file
+
+    if (parallel) p.Process(input, jobs);
+    else p.Finish();
+
+    if (!p.GetMessage().empty()) std::cerr << p.GetMessage() << std::endl;
+}
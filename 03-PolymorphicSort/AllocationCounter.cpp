@@ -0,0 +1,87 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<bool> s_counting{ false };
+	std::atomic<size_t> s_allocations{ 0 };
+
+	void* allocate(size_t size)
+	{
+		if (s_counting.load(std::memory_order_relaxed)) s_allocations.fetch_add(1, std::memory_order_relaxed);
+
+		void* ptr = std::malloc(size != 0 ? size : 1);
+		if (!ptr) throw std::bad_alloc();
+		return ptr;
+	}
+}
+
+void setAllocationCounting(bool enabled)
+{
+	s_counting = enabled;
+}
+
+size_t allocationCount()
+{
+	return s_allocations;
+}
+
+void* operator new(size_t size)
+{
+	return allocate(size);
+}
+
+void* operator new[](size_t size)
+{
+	return allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	try
+	{
+		return allocate(size);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return nullptr;
+	}
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+	return operator new(size, tag);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	std::free(ptr);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+
+// Counts the calls of the global operator new while enabled. The replacement
+// operators live in AllocationCounter.cpp, so the counter only exists in the
+// programs linking it.
+void setAllocationCounting(bool enabled);
+
+size_t allocationCount();
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <new>
+#include <string_view>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Bump allocator for the text of the lines read from a stream. All bytes live
+// in a single anonymous mapping, so lines and keys can keep referring to them
+// by offset. The mapping grows with mremap, which moves pages instead of
+// copying them, so growing never needs twice the memory. Freeing is a single
+// munmap.
+class Arena
+{
+public:
+	Arena() = default;
+	Arena(const Arena&) = delete;
+	Arena& operator= (const Arena&) = delete;
+
+	~Arena()
+	{
+		Free();
+	}
+
+	// Appends size bytes and returns a pointer to them. Growing may move the
+	// whole arena, which invalidates earlier pointers, but not offsets.
+	char* Allocate(size_t size)
+	{
+		if (m_size + size > m_capacity) grow(m_size + size);
+
+		char* ptr = m_data + m_size;
+		m_size += size;
+		return ptr;
+	}
+
+	// Gives back the last size bytes allocated.
+	void Trim(size_t size)
+	{
+		m_size -= size;
+	}
+
+	// Appends the rest of the stream.
+	void ReadAll(std::istream& input)
+	{
+		while (true)
+		{
+			char* dest = Allocate(ReadChunk);
+			std::streamsize read = input.rdbuf()->sgetn(dest, ReadChunk);
+			Trim(ReadChunk - (size_t)read);
+			if (read == 0) break;
+		}
+	}
+
+	// Forgets the contents, but keeps the memory for reuse.
+	void Clear()
+	{
+		m_size = 0;
+	}
+
+	// Returns the memory to the system.
+	void Free()
+	{
+		if (m_data) munmap(m_data, m_capacity);
+		m_data = nullptr;
+		m_size = 0;
+		m_capacity = 0;
+	}
+
+	std::string_view View() const
+	{
+		return std::string_view(m_data, m_size);
+	}
+
+	size_t Size() const
+	{
+		return m_size;
+	}
+
+private:
+	static constexpr size_t ReadChunk = 1 << 20;
+	static constexpr size_t MinCapacity = 16 << 20;
+
+	void grow(size_t needed)
+	{
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		size_t capacity = std::max({ needed, m_capacity * 2, MinCapacity });
+		capacity = (capacity + page - 1) / page * page;
+
+		void* data = m_data
+			? mremap(m_data, m_capacity, capacity, MREMAP_MAYMOVE)
+			: mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (data == MAP_FAILED) throw std::bad_alloc();
+
+		m_data = static_cast<char*>(data);
+		m_capacity = capacity;
+	}
+
+	char* m_data = nullptr;
+	size_t m_size = 0;
+	size_t m_capacity = 0;
+};
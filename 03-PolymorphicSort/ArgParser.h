@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Utilities.h"
+
+class ArgParser
+{
+public:
+	// Options take a value, flags don't.
+	ArgParser(const std::vector<std::string>& args, const std::vector<char>& options, const std::vector<char>& flags = {})
+		: m_args(args), m_opts(options), m_flags(flags)
+	{}
+
+	bool Parse()
+	{
+		for (auto& flag : m_flags)
+		{
+			auto found = std::remove(m_args.begin(), m_args.end(), "-" + std::string(1, flag));
+			if (found != m_args.end()) m_setFlags.push_back(flag);
+			m_args.erase(found, m_args.end());
+		}
+
+		for (auto& opt : m_opts)
+		{
+			for (size_t i = 0; i < m_args.size(); ++i)
+			{
+				if (m_args[i].substr(0, 2) == "-" + std::string(1, opt))
+				{
+					if (m_args[i].length() > 2)
+					{
+						m_optValues[opt] = m_args[i].substr(2, m_args[i].length() - 2);
+						m_args.erase(m_args.begin() + i);
+						--i; // This is to compensate for the increment at the end
+					}
+					else
+					{
+						if (m_args.size() <= i + 1 || m_args[i + 1][0] == '-' || std::isupper(m_args[i + 1][0]))
+						{
+							return false;
+						}
+
+						m_optValues[opt] = m_args[i + 1];
+						m_args.erase(m_args.begin() + i, m_args.begin() + i + 2);
+						--i; // This is to compensate for the increment at the end
+					}
+				}
+			}
+		}
+
+		for (auto& arg : m_args)
+		{
+			if (!std::isupper(arg[0])) return false;
+
+			auto colnum = strToInt(arg.substr(1, arg.length() - 1));
+
+			if (!colnum) return false;
+
+			m_parsedCols.push_back({ arg[0], (size_t)*colnum });
+		}
+
+		return true;
+	}
+
+	bool HasOptionValue(char option)
+	{
+		return m_optValues.find(option) != m_optValues.end();
+	}
+
+	bool HasFlag(char flag)
+	{
+		return std::find(m_setFlags.begin(), m_setFlags.end(), flag) != m_setFlags.end();
+	}
+
+	std::string GetOptionValue(char option)
+	{
+		return m_optValues[option];
+	}
+
+	std::vector<ColIdentifier> GetRequired()
+	{
+		return m_parsedCols;
+	}
+private:
+	std::vector<std::string> m_args;
+	std::vector<char> m_opts;
+	std::vector<char> m_flags;
+	std::vector<char> m_setFlags;
+	std::vector<ColIdentifier> m_parsedCols;
+	std::unordered_map<char, std::string> m_optValues;
+};
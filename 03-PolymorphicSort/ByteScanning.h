@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "Utilities.h"
+
+// Calls f(position) for every occurrence of byte in the text, in order, until
+// f returns false. Returns false if it was stopped that way. The text is
+// compared 32 (AVX2) or 16 (SSE2) bytes at a time when the target supports
+// it, and the matches of a block are taken from its bit mask.
+template <typename F>
+bool forEachByte(std::string_view text, char byte, F&& f)
+{
+	const char* data = text.data();
+	size_t length = text.length();
+	size_t pos = 0;
+
+#if defined(__AVX2__)
+	const __m256i needle32 = _mm256_set1_epi8(byte);
+	for (; pos + 32 <= length; pos += 32)
+	{
+		__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle32));
+		for (; mask != 0; mask &= mask - 1)
+		{
+			if (!f(pos + __builtin_ctz(mask))) return false;
+		}
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i needle16 = _mm_set1_epi8(byte);
+	for (; pos + 16 <= length; pos += 16)
+	{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle16));
+		for (; mask != 0; mask &= mask - 1)
+		{
+			if (!f(pos + __builtin_ctz(mask))) return false;
+		}
+	}
+#endif
+
+	for (; pos < length; ++pos)
+	{
+		if (data[pos] == byte && !f(pos)) return false;
+	}
+
+	return true;
+}
+
+// Returns the number of occurrences of byte in the text, taking the matches
+// of a whole block at once from the population count of its bit mask.
+inline size_t countByte(std::string_view text, char byte)
+{
+	const char* data = text.data();
+	size_t length = text.length();
+	size_t pos = 0;
+	size_t count = 0;
+
+#if defined(__AVX2__)
+	const __m256i needle32 = _mm256_set1_epi8(byte);
+	for (; pos + 32 <= length; pos += 32)
+	{
+		__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+		count += __builtin_popcount((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle32)));
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i needle16 = _mm_set1_epi8(byte);
+	for (; pos + 16 <= length; pos += 16)
+	{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+		count += __builtin_popcount((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle16)));
+	}
+#endif
+
+	for (; pos < length; ++pos) count += data[pos] == byte;
+
+	return count;
+}
+
+// Returns the position of the first occurrence of byte at or after begin, or
+// the length of the text if there is none.
+inline size_t findByte(std::string_view text, size_t begin, char byte)
+{
+	size_t found = text.length();
+	forEachByte(text.substr(begin), byte, [&found, begin](size_t pos) { found = begin + pos; return false; });
+	return found;
+}
+
+// Finds the fields with the given numbers (1-based, ascending) in the line
+// and returns how many of them exist. Fields that aren't asked for are only
+// counted and the line isn't scanned past the last field needed.
+// Matches splitting with std::getline, which means a field starting at the
+// very end of the line doesn't exist.
+inline size_t findFields(std::string_view line, char delim, const std::vector<size_t>& numbers, std::vector<Slice>& fields)
+{
+	fields.resize(numbers.size());
+	if (numbers.empty()) return 0;
+
+	size_t found = 0;
+	size_t number = 1;
+	size_t fieldBegin = 0;
+	bool complete = !forEachByte(line, delim, [&](size_t pos)
+	{
+		if (number == numbers[found])
+		{
+			fields[found++] = { fieldBegin, pos - fieldBegin };
+			if (found == numbers.size()) return false;
+		}
+
+		++number;
+		fieldBegin = pos + 1;
+		return true;
+	});
+
+	if (!complete && fieldBegin < line.length() && number == numbers[found])
+	{
+		fields[found++] = { fieldBegin, line.length() - fieldBegin };
+	}
+
+	return found;
+}
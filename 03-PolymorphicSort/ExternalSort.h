@@ -0,0 +1,75 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "KeyStore.h"
+
+// A temporary file that gets removed once it goes out of scope.
+class TempFile
+{
+public:
+	TempFile(const std::filesystem::path& path)
+		: m_path(path)
+	{}
+
+	TempFile(TempFile&& other) noexcept
+		: m_path(std::move(other.m_path))
+	{
+		other.m_path.clear();
+	}
+
+	TempFile& operator= (TempFile&& other) noexcept
+	{
+		std::swap(m_path, other.m_path);
+		return *this;
+	}
+
+	~TempFile()
+	{
+		std::error_code ec;
+		if (!m_path.empty()) std::filesystem::remove(m_path, ec);
+	}
+
+	const std::filesystem::path& Path() const
+	{
+		return m_path;
+	}
+
+private:
+	std::filesystem::path m_path;
+};
+
+// Reads a sorted run back from its file, one line at a time, and keeps the
+// keys of the current line so runs can be merged.
+class RunReader
+{
+public:
+	RunReader(const std::filesystem::path& path, const std::vector<ColIdentifier>& cols, char delim)
+		: m_file(path, std::ios::binary), m_current(cols), m_delim(delim)
+	{}
+
+	// Moves to the next line of the run, returns false at its end.
+	bool Next()
+	{
+		if (!std::getline(m_file, m_current.Line())) return false;
+
+		// The lines were validated before the run was written out.
+		size_t failedColumn = 0;
+		m_current.Parse(m_delim, failedColumn);
+		return true;
+	}
+
+	const KeyedLine& Current() const
+	{
+		return m_current;
+	}
+
+private:
+	std::ifstream m_file;
+	KeyedLine m_current;
+	char m_delim;
+};
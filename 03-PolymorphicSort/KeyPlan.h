@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+#include "KeyStore.h"
+
+// Comparators of whole rows for the common layouts of key columns. The
+// storage of every column is a template parameter, so the comparison of a
+// row compiles down to a few inlined integer and string comparisons instead
+// of a loop that switches on the storage of each column. The layout is
+// matched once per sort by dispatchKeyPlan.
+
+template <KeyStorage Storage>
+class PlanColumn;
+
+template <>
+class PlanColumn<KeyStorage::Narrow>
+{
+public:
+	PlanColumn(const KeyColumn& col)
+		: m_keys(col.Numbers().data())
+	{}
+
+	int Compare(RowIndex a, RowIndex b) const
+	{
+		return (m_keys[a] > m_keys[b]) - (m_keys[a] < m_keys[b]);
+	}
+
+private:
+	const int32_t* m_keys;
+};
+
+template <>
+class PlanColumn<KeyStorage::Wide>
+{
+public:
+	PlanColumn(const KeyColumn& col)
+		: m_keys(col.WideNumbers().data())
+	{}
+
+	int Compare(RowIndex a, RowIndex b) const
+	{
+		return (m_keys[a] > m_keys[b]) - (m_keys[a] < m_keys[b]);
+	}
+
+private:
+	const int64_t* m_keys;
+};
+
+template <>
+class PlanColumn<KeyStorage::String>
+{
+public:
+	PlanColumn(const KeyColumn& col)
+		: m_keys(col.Strings().data())
+	{}
+
+	int Compare(RowIndex a, RowIndex b) const
+	{
+		return StringKey::Compare(m_keys[a], m_keys[b]);
+	}
+
+private:
+	const StringKey* m_keys;
+};
+
+// Compares rows by the columns of a fixed layout. Has the same results as
+// KeyStore::CompareColumns, with the last column being the last one of the
+// store.
+template <KeyStorage... Storages>
+class KeyPlan
+{
+public:
+	KeyPlan(const KeyStore& keys)
+		: KeyPlan(keys, std::index_sequence_for<PlanColumn<Storages>...>())
+	{}
+
+	// Three-way comparison of the columns from firstColumn on.
+	int Compare(RowIndex a, RowIndex b, size_t firstColumn = 0) const
+	{
+		return std::apply([a, b, firstColumn](const auto&... cols)
+		{
+			int cmp = 0;
+			size_t index = 0;
+			((index++ < firstColumn || (cmp = cols.Compare(a, b)) == 0) && ...);
+			return cmp;
+		}, m_columns);
+	}
+
+	static bool Matches(const KeyStore& keys)
+	{
+		auto& cols = keys.Columns();
+		if (cols.size() != sizeof...(Storages)) return false;
+
+		size_t index = 0;
+		return ((cols[index++].Storage() == Storages) && ...);
+	}
+
+private:
+	template <size_t... Indices>
+	KeyPlan(const KeyStore& keys, std::index_sequence<Indices...>)
+		: m_columns(PlanColumn<Storages>(keys.Columns()[Indices])...)
+	{}
+
+	std::tuple<PlanColumn<Storages>...> m_columns;
+};
+
+// Fallback for any other layout, goes through the storage switch of every
+// column.
+class GenericKeyPlan
+{
+public:
+	GenericKeyPlan(const KeyStore& keys)
+		: m_keys(keys)
+	{}
+
+	int Compare(RowIndex a, RowIndex b, size_t firstColumn = 0) const
+	{
+		return m_keys.CompareColumns(a, b, firstColumn, m_keys.Columns().size());
+	}
+
+private:
+	const KeyStore& m_keys;
+};
+
+// Wraps another plan and counts its comparisons for the stats. Only this
+// instantiation of the sort pays for the counting.
+template <typename Plan>
+class CountingKeyPlan
+{
+public:
+	CountingKeyPlan(const Plan& plan, std::atomic<size_t>& comparisons)
+		: m_plan(plan), m_comparisons(comparisons)
+	{}
+
+	int Compare(RowIndex a, RowIndex b, size_t firstColumn = 0) const
+	{
+		m_comparisons.fetch_add(1, std::memory_order_relaxed);
+		return m_plan.Compare(a, b, firstColumn);
+	}
+
+private:
+	const Plan& m_plan;
+	std::atomic<size_t>& m_comparisons;
+};
+
+// Calls f with the plan matching the layout of the key columns.
+template <typename F>
+void dispatchKeyPlan(const KeyStore& keys, F&& f)
+{
+	using S = KeyStorage;
+
+	if (KeyPlan<S::Narrow>::Matches(keys)) f(KeyPlan<S::Narrow>(keys));
+	else if (KeyPlan<S::Wide>::Matches(keys)) f(KeyPlan<S::Wide>(keys));
+	else if (KeyPlan<S::String>::Matches(keys)) f(KeyPlan<S::String>(keys));
+	else if (KeyPlan<S::Narrow, S::String>::Matches(keys)) f(KeyPlan<S::Narrow, S::String>(keys));
+	else if (KeyPlan<S::String, S::Narrow>::Matches(keys)) f(KeyPlan<S::String, S::Narrow>(keys));
+	else f(GenericKeyPlan(keys));
+}
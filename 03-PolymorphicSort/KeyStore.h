@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ByteScanning.h"
+#include "KeyTypes.h"
+#include "Utilities.h"
+
+// Index of a line in the input, used as the element of the sorted permutation.
+using RowIndex = uint32_t;
+
+// A string key together with its first 8 bytes packed into a big-endian
+// integer (zero padded). Keys with different prefixes are ordered by a
+// single integer comparison without touching the text at all. The text
+// points into the line the key was extracted from.
+struct StringKey
+{
+	uint64_t Prefix;
+	std::string_view Text;
+
+	static StringKey Make(std::string_view str)
+	{
+		unsigned char bytes[8] = {};
+		std::memcpy(bytes, str.data(), std::min<size_t>(str.length(), 8));
+
+		uint64_t prefix = 0;
+		for (unsigned char byte : bytes) prefix = (prefix << 8) | byte;
+
+		return { prefix, str };
+	}
+
+	// Same result as comparing the whole strings with std::string_view.
+	static int Compare(const StringKey& lhs, const StringKey& rhs)
+	{
+		if (lhs.Prefix != rhs.Prefix) return lhs.Prefix < rhs.Prefix ? -1 : 1;
+
+		// With equal prefixes, a string of up to 8 bytes is a prefix of the other one.
+		if (std::min(lhs.Text.length(), rhs.Text.length()) <= 8)
+		{
+			return (lhs.Text.length() > rhs.Text.length()) - (lhs.Text.length() < rhs.Text.length());
+		}
+
+		return lhs.Text.substr(8).compare(rhs.Text.substr(8));
+	}
+};
+
+// How the values of a key column are stored: N keys as 32-bit integers, the
+// 64-bit key types as order-preserving 64-bit integers, S keys as StringKeys.
+enum class KeyStorage { Narrow, Wide, String };
+
+// Holds the values of a single sort column for all lines in one contiguous
+// array. Only the array matching the storage of the column is ever used.
+class KeyColumn
+{
+public:
+	KeyColumn(const ColIdentifier& id)
+		: m_id(id), m_storage(id.Type == 'N' ? KeyStorage::Narrow : isWideKeyType(id.Type) ? KeyStorage::Wide : KeyStorage::String)
+	{}
+
+	const ColIdentifier& Id() const
+	{
+		return m_id;
+	}
+
+	KeyStorage Storage() const
+	{
+		return m_storage;
+	}
+
+	// Returns true if the keys are integers that can be radix sorted.
+	bool IsInteger() const
+	{
+		return m_storage != KeyStorage::String;
+	}
+
+	void Resize(size_t count)
+	{
+		switch (m_storage)
+		{
+		case KeyStorage::Narrow: m_numbers.resize(count); break;
+		case KeyStorage::Wide: m_wideNumbers.resize(count); break;
+		case KeyStorage::String: m_strings.resize(count); break;
+		}
+	}
+
+	// Number of bytes a single value takes up in the column.
+	size_t ValueSize() const
+	{
+		switch (m_storage)
+		{
+		case KeyStorage::Narrow: return sizeof(int32_t);
+		case KeyStorage::Wide: return sizeof(int64_t);
+		default: return sizeof(StringKey);
+		}
+	}
+
+	// Returns false if the field doesn't hold a valid value for this column.
+	bool Set(RowIndex row, std::string_view field)
+	{
+		if (m_storage == KeyStorage::String)
+		{
+			m_strings[row] = StringKey::Make(field);
+			return true;
+		}
+
+		if (m_storage == KeyStorage::Narrow)
+		{
+			auto val = strToInt(field);
+			if (!val) return false;
+			m_numbers[row] = *val;
+			return true;
+		}
+
+		std::optional<int64_t> val;
+		switch (m_id.Type)
+		{
+		case 'L': val = parseIntegerKey(field); break;
+		case 'F': val = parseFloatKey(field); break;
+		case 'D': val = parseDecimalKey(field); break;
+		case 'T': val = parseTimestampKey(field); break;
+		}
+
+		if (!val) return false;
+		m_wideNumbers[row] = *val;
+		return true;
+	}
+
+	const std::vector<int32_t>& Numbers() const
+	{
+		return m_numbers;
+	}
+
+	const std::vector<int64_t>& WideNumbers() const
+	{
+		return m_wideNumbers;
+	}
+
+	const std::vector<StringKey>& Strings() const
+	{
+		return m_strings;
+	}
+
+	// Hash of the key of the row, equal for rows whose keys compare equal.
+	size_t Hash(RowIndex row) const
+	{
+		switch (m_storage)
+		{
+		case KeyStorage::Narrow: return std::hash<int32_t>()(m_numbers[row]);
+		case KeyStorage::Wide: return std::hash<int64_t>()(m_wideNumbers[row]);
+		default: return std::hash<std::string_view>()(m_strings[row].Text);
+		}
+	}
+
+	// Three-way comparison of row a of this column with row b of another
+	// column of the same type.
+	int Compare(RowIndex a, const KeyColumn& other, RowIndex b) const
+	{
+		switch (m_storage)
+		{
+		case KeyStorage::Narrow: return compareIntegers(m_numbers[a], other.m_numbers[b]);
+		case KeyStorage::Wide: return compareIntegers(m_wideNumbers[a], other.m_wideNumbers[b]);
+		default: return StringKey::Compare(m_strings[a], other.m_strings[b]);
+		}
+	}
+
+private:
+	template <typename T>
+	static int compareIntegers(T a, T b)
+	{
+		return (a > b) - (a < b);
+	}
+
+	ColIdentifier m_id;
+	KeyStorage m_storage;
+	std::vector<int32_t> m_numbers;
+	std::vector<int64_t> m_wideNumbers;
+	std::vector<StringKey> m_strings;
+};
+
+// All sort columns of the input in priority order.
+class KeyStore
+{
+public:
+	void Init(const std::vector<ColIdentifier>& cols)
+	{
+		m_columns.clear();
+		m_fieldNumbers.clear();
+		for (auto& col : cols)
+		{
+			m_columns.emplace_back(col);
+			if (col.Number != 0) m_fieldNumbers.push_back(col.Number);
+		}
+
+		std::sort(m_fieldNumbers.begin(), m_fieldNumbers.end());
+		m_fieldNumbers.erase(std::unique(m_fieldNumbers.begin(), m_fieldNumbers.end()), m_fieldNumbers.end());
+
+		m_fieldSlots.clear();
+		for (auto& col : cols)
+		{
+			auto slot = std::lower_bound(m_fieldNumbers.begin(), m_fieldNumbers.end(), col.Number);
+			m_fieldSlots.push_back(col.Number != 0 ? slot - m_fieldNumbers.begin() : m_fieldNumbers.size());
+		}
+	}
+
+	// Prepares the store for the given number of lines.
+	void Reset(size_t rows)
+	{
+		for (auto& col : m_columns) col.Resize(rows);
+	}
+
+	// Parses the keys of a line and stores them in the given row. String keys
+	// point into the line, so it has to outlive their use.
+	// On failure, failedColumn is set to the number of the offending column.
+	// Different rows may be extracted concurrently, each thread passing its
+	// own scratch vector for the fields.
+	bool Extract(RowIndex row, std::string_view line, char delim, std::vector<Slice>& fields, size_t& failedColumn)
+	{
+		size_t found = findFields(line, delim, m_fieldNumbers, fields);
+
+		for (size_t i = 0; i < m_columns.size(); ++i)
+		{
+			KeyColumn& col = m_columns[i];
+			if (m_fieldSlots[i] >= found)
+			{
+				failedColumn = col.Id().Number;
+				return false;
+			}
+
+			const Slice& field = fields[m_fieldSlots[i]];
+			if (!col.Set(row, line.substr(field.Offset, field.Length)))
+			{
+				failedColumn = col.Id().Number;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Number of bytes the keys of a single row take up.
+	size_t RowSize() const
+	{
+		size_t size = 0;
+		for (auto& col : m_columns) size += col.ValueSize();
+		return size;
+	}
+
+	const std::vector<KeyColumn>& Columns() const
+	{
+		return m_columns;
+	}
+
+	// Compares all keys lexicographically, so a single stable sort with this
+	// predicate orders the lines by every sort column at once.
+	int Compare(RowIndex a, const KeyStore& other, RowIndex b) const
+	{
+		return compare(a, other, b, 0, m_columns.size());
+	}
+
+	// Hash of all keys of the row, equal for rows that compare equal.
+	size_t Hash(RowIndex row) const
+	{
+		size_t hash = 0;
+		for (auto& col : m_columns) hash = hash * 31 + col.Hash(row);
+		return hash;
+	}
+
+	// Same as Compare, but only looks at columns [firstColumn, lastColumn).
+	int CompareColumns(RowIndex a, RowIndex b, size_t firstColumn, size_t lastColumn) const
+	{
+		return compare(a, *this, b, firstColumn, lastColumn);
+	}
+
+private:
+	int compare(RowIndex a, const KeyStore& other, RowIndex b, size_t firstColumn, size_t lastColumn) const
+	{
+		for (size_t i = firstColumn; i < lastColumn; ++i)
+		{
+			int cmp = m_columns[i].Compare(a, other.m_columns[i], b);
+			if (cmp != 0) return cmp;
+		}
+
+		return 0;
+	}
+
+	std::vector<KeyColumn> m_columns;
+
+	// The distinct field numbers of the columns in ascending order, and for
+	// each column the index of its field among them.
+	std::vector<size_t> m_fieldNumbers;
+	std::vector<size_t> m_fieldSlots;
+};
+
+// A single line with its own keys, for the places where lines are handled
+// one at a time rather than as a whole buffer. The keys point into the line,
+// so it can't be copied or moved.
+class KeyedLine
+{
+public:
+	KeyedLine(const std::vector<ColIdentifier>& cols)
+	{
+		m_keys.Init(cols);
+	}
+
+	KeyedLine(const KeyedLine&) = delete;
+	KeyedLine& operator= (const KeyedLine&) = delete;
+
+	std::string& Line()
+	{
+		return m_line;
+	}
+
+	const std::string& Line() const
+	{
+		return m_line;
+	}
+
+	// Extracts the keys of the current contents of the line.
+	bool Parse(char delim, size_t& failedColumn)
+	{
+		m_keys.Reset(1);
+		return m_keys.Extract(0, m_line, delim, m_fields, failedColumn);
+	}
+
+	int Compare(const KeyedLine& other) const
+	{
+		return m_keys.Compare(0, other.m_keys, 0);
+	}
+
+	size_t Hash() const
+	{
+		return m_keys.Hash(0);
+	}
+
+private:
+	std::string m_line;
+	std::vector<Slice> m_fields;
+	KeyStore m_keys;
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+// Parsers of the 64-bit key types. Every value is turned into an int64_t whose
+// signed order is the order of the values, so all of these types share the
+// same storage, comparison and radix passes.
+//
+//   L  signed 64-bit integer, e.g. -42
+//   F  floating point number, e.g. 1.5e-3 or -inf (NaN is rejected)
+//   D  fixed-point decimal with up to DecimalDigits fractional digits, e.g. -12.75
+//   T  ISO 8601 date or timestamp, e.g. 2024-03-01 or 2024-03-01T12:30:00.250+01:00
+
+// Number of fractional digits a D key keeps.
+constexpr size_t DecimalDigits = 6;
+
+// Returns true if the type is one of the 64-bit key types above.
+inline bool isWideKeyType(char type)
+{
+	return type == 'L' || type == 'F' || type == 'D' || type == 'T';
+}
+
+inline std::optional<int64_t> parseIntegerKey(std::string_view num)
+{
+	int64_t parsed = 0;
+	auto [ptr, ec] { std::from_chars(num.data(), num.data() + num.size(), parsed) };
+
+	if (ec != std::errc() || ptr != num.data() + num.size()) return std::nullopt;
+
+	return parsed;
+}
+
+// The bits of a double are ordered like its value as long as it's positive.
+// For negative values all bits but the sign are flipped, which reverses their
+// order. Negative zero is turned into zero first, so that the two are equal.
+inline std::optional<int64_t> parseFloatKey(std::string_view num)
+{
+	double parsed = 0;
+	auto [ptr, ec] { std::from_chars(num.data(), num.data() + num.size(), parsed) };
+
+	if (ec != std::errc() || ptr != num.data() + num.size() || std::isnan(parsed)) return std::nullopt;
+
+	parsed += 0.0;
+	int64_t bits = 0;
+	std::memcpy(&bits, &parsed, sizeof(bits));
+
+	return bits < 0 ? bits ^ std::numeric_limits<int64_t>::max() : bits;
+}
+
+// Scales the number by 10^DecimalDigits. Rejects more fractional digits than
+// that rather than rounding, so that distinct values never compare equal.
+inline std::optional<int64_t> parseDecimalKey(std::string_view num)
+{
+	bool negative = !num.empty() && num.front() == '-';
+	if (negative) num.remove_prefix(1);
+
+	size_t point = num.find('.');
+	std::string_view whole = num.substr(0, point);
+	std::string_view fraction = point != std::string_view::npos ? num.substr(point + 1) : std::string_view();
+
+	if (whole.empty() || fraction.length() > DecimalDigits) return std::nullopt;
+	if (point != std::string_view::npos && fraction.empty()) return std::nullopt;
+
+	int64_t value = 0;
+	for (std::string_view digits : { whole, fraction })
+	{
+		for (char digit : digits)
+		{
+			if (digit < '0' || digit > '9') return std::nullopt;
+			if (__builtin_mul_overflow(value, 10, &value) || __builtin_add_overflow(value, digit - '0', &value)) return std::nullopt;
+		}
+	}
+
+	for (size_t i = fraction.length(); i < DecimalDigits; ++i)
+	{
+		if (__builtin_mul_overflow(value, 10, &value)) return std::nullopt;
+	}
+
+	return negative ? -value : value;
+}
+
+namespace detail
+{
+	// Parses exactly digits decimal digits from the front of text.
+	inline bool takeNumber(std::string_view& text, size_t digits, int64_t& value)
+	{
+		if (text.length() < digits) return false;
+
+		value = 0;
+		for (size_t i = 0; i < digits; ++i)
+		{
+			if (text[i] < '0' || text[i] > '9') return false;
+			value = value * 10 + (text[i] - '0');
+		}
+
+		text.remove_prefix(digits);
+		return true;
+	}
+
+	inline bool takeChar(std::string_view& text, char ch)
+	{
+		if (text.empty() || text.front() != ch) return false;
+
+		text.remove_prefix(1);
+		return true;
+	}
+
+	// Days since 1970-01-01 of a date of the proleptic Gregorian calendar.
+	inline int64_t daysFromCivil(int64_t year, int64_t month, int64_t day)
+	{
+		year -= month <= 2;
+		int64_t era = (year >= 0 ? year : year - 399) / 400;
+		int64_t yearOfEra = year - era * 400;
+		int64_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+		int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+		return era * 146097 + dayOfEra - 719468;
+	}
+
+	inline int64_t daysInMonth(int64_t year, int64_t month)
+	{
+		static constexpr int64_t days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+		bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+		return month == 2 && leap ? 29 : days[month - 1];
+	}
+}
+
+// Microseconds since 1970-01-01T00:00:00Z. Accepts YYYY-MM-DD optionally
+// followed by THH:MM, seconds, up to six fractional digits of a second and a
+// Z or +HH:MM/-HH:MM offset. Times without an offset are taken as UTC.
+inline std::optional<int64_t> parseTimestampKey(std::string_view text)
+{
+	using detail::takeChar;
+	using detail::takeNumber;
+
+	int64_t year = 0, month = 0, day = 0;
+	if (!takeNumber(text, 4, year) || !takeChar(text, '-') || !takeNumber(text, 2, month) || !takeChar(text, '-') || !takeNumber(text, 2, day)) return std::nullopt;
+	if (month < 1 || month > 12 || day < 1 || day > detail::daysInMonth(year, month)) return std::nullopt;
+
+	int64_t seconds = detail::daysFromCivil(year, month, day) * 86400;
+	int64_t micros = 0;
+
+	if (takeChar(text, 'T'))
+	{
+		int64_t hour = 0, minute = 0, second = 0;
+		if (!takeNumber(text, 2, hour) || !takeChar(text, ':') || !takeNumber(text, 2, minute)) return std::nullopt;
+		if (takeChar(text, ':') && !takeNumber(text, 2, second)) return std::nullopt;
+		if (hour > 23 || minute > 59 || second > 60) return std::nullopt;
+
+		if (takeChar(text, '.'))
+		{
+			size_t digits = 0;
+			while (digits < text.length() && text[digits] >= '0' && text[digits] <= '9') ++digits;
+			if (digits == 0 || digits > 6 || !takeNumber(text, digits, micros)) return std::nullopt;
+			for (size_t i = digits; i < 6; ++i) micros *= 10;
+		}
+
+		seconds += hour * 3600 + minute * 60 + second;
+
+		if (!takeChar(text, 'Z') && !text.empty())
+		{
+			int64_t sign = text.front() == '-' ? -1 : 1;
+			int64_t offsetHour = 0, offsetMinute = 0;
+			if (!(takeChar(text, '+') || takeChar(text, '-'))) return std::nullopt;
+			if (!takeNumber(text, 2, offsetHour) || !takeChar(text, ':') || !takeNumber(text, 2, offsetMinute)) return std::nullopt;
+			if (offsetHour > 23 || offsetMinute > 59) return std::nullopt;
+
+			seconds -= sign * (offsetHour * 3600 + offsetMinute * 60);
+		}
+	}
+
+	if (!text.empty()) return std::nullopt;
+
+	return seconds * 1000000 + micros;
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <future>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Collects the output into large writes. When writing to a file descriptor,
+// long lines whose memory stays valid until the next flush are passed to
+// writev by reference, everything else is copied into a staging buffer that
+// is written as a whole. Optionally, full buffers are written by a background
+// thread while the next one is being filled.
+class OutputWriter
+{
+public:
+	// Writes to the file descriptor if it's valid, otherwise to the stream.
+	OutputWriter(std::ostream& stream, int fd = -1)
+		: m_stream(stream), m_fd(fd)
+	{
+		m_buffer.reserve(BufferSize);
+	}
+
+	OutputWriter(const OutputWriter&) = delete;
+	OutputWriter& operator= (const OutputWriter&) = delete;
+
+	~OutputWriter()
+	{
+		Flush();
+	}
+
+	// Writes full buffers on a background thread from now on. Data is always
+	// copied in this mode, as the caller can't know when it gets written.
+	void StartAsync()
+	{
+		flushSegments();
+		m_async = true;
+	}
+
+	// Appends the line followed by a newline. If persistent is set, the line
+	// has to stay valid until the next Flush, so that it can be referenced.
+	void WriteLine(std::string_view line, bool persistent = false)
+	{
+		if (persistent && canReference(line))
+		{
+			reference(line);
+			reference("\n");
+			return;
+		}
+
+		if (m_buffer.length() + line.length() + 1 > BufferSize) flushBuffer();
+		if (line.length() + 1 > BufferSize)
+		{
+			writeAll(line);
+			writeAll("\n");
+			return;
+		}
+
+		m_buffer.append(line).push_back('\n');
+	}
+
+	// Appends raw data, with the same meaning of persistent as in WriteLine.
+	void Write(std::string_view data, bool persistent = false)
+	{
+		if (persistent && canReference(data))
+		{
+			reference(data);
+			return;
+		}
+
+		if (m_buffer.length() + data.length() > BufferSize) flushBuffer();
+		if (data.length() > BufferSize)
+		{
+			writeAll(data);
+			return;
+		}
+
+		m_buffer.append(data);
+	}
+
+	// Writes out everything and waits for the background writes. Returns
+	// false if any write since the construction failed.
+	bool Flush()
+	{
+		flushSegments();
+		if (m_async) flushBuffer();
+		waitForPending();
+		if (!m_async) flushBuffer();
+
+		if (m_fd < 0 && !m_stream.flush()) m_failed = true;
+		return !m_failed;
+	}
+
+	// Number of bytes written out so far, complete only after Flush.
+	size_t BytesWritten() const
+	{
+		return m_bytesWritten;
+	}
+
+private:
+	static constexpr size_t BufferSize = 1 << 20;
+
+	// Lines shorter than this are cheaper to copy than to reference.
+	static constexpr size_t ReferenceMinLength = 256;
+
+#ifdef IOV_MAX
+	static constexpr size_t MaxSegments = IOV_MAX;
+#else
+	static constexpr size_t MaxSegments = 16;
+#endif
+
+	bool canReference(std::string_view data) const
+	{
+		return m_fd >= 0 && !m_async && data.length() >= ReferenceMinLength;
+	}
+
+	void reference(std::string_view data)
+	{
+		if (m_segments.size() + 2 > MaxSegments) flushSegments();
+
+		closeBufferSegment();
+		m_segments.push_back({ const_cast<char*>(data.data()), data.length() });
+	}
+
+	// Makes the part of the buffer since the last segment a segment of its own,
+	// so that the order of referenced and copied data is kept.
+	void closeBufferSegment()
+	{
+		if (m_buffer.length() > m_bufferSegmentStart)
+		{
+			m_segments.push_back({ m_buffer.data() + m_bufferSegmentStart, m_buffer.length() - m_bufferSegmentStart });
+			m_bufferSegmentStart = m_buffer.length();
+		}
+	}
+
+	void flushSegments()
+	{
+		if (m_segments.empty()) return;
+
+		closeBufferSegment();
+		if (!writeSegments(m_segments)) m_failed = true;
+		m_segments.clear();
+		m_buffer.clear();
+		m_bufferSegmentStart = 0;
+	}
+
+	void flushBuffer()
+	{
+		if (!m_segments.empty())
+		{
+			flushSegments();
+			return;
+		}
+
+		if (m_buffer.empty()) return;
+
+		if (!m_async)
+		{
+			writeAll(m_buffer);
+			m_buffer.clear();
+			return;
+		}
+
+		waitForPending();
+		std::swap(m_buffer, m_inFlight);
+		m_buffer.clear();
+		m_buffer.reserve(BufferSize);
+		m_pending = std::async(std::launch::async, [this]() { return write(m_inFlight); });
+	}
+
+	void waitForPending()
+	{
+		if (m_pending.valid() && !m_pending.get()) m_failed = true;
+	}
+
+	void writeAll(std::string_view data)
+	{
+		if (m_async) waitForPending();
+		if (!write(data)) m_failed = true;
+	}
+
+	bool write(std::string_view data)
+	{
+		if (m_fd < 0)
+		{
+			m_bytesWritten += data.length();
+			return (bool)m_stream.write(data.data(), data.length());
+		}
+
+		std::vector<iovec> segments{ { const_cast<char*>(data.data()), data.length() } };
+		return writeSegments(segments);
+	}
+
+	// Calls writev until all segments are written, resuming after partial writes.
+	bool writeSegments(std::vector<iovec>& segments)
+	{
+		if (m_fd < 0)
+		{
+			for (auto& segment : segments)
+			{
+				m_stream.write(static_cast<const char*>(segment.iov_base), segment.iov_len);
+				m_bytesWritten += segment.iov_len;
+			}
+			return (bool)m_stream;
+		}
+
+		size_t first = 0;
+		while (first < segments.size())
+		{
+			ssize_t written = writev(m_fd, segments.data() + first, (int)std::min(segments.size() - first, MaxSegments));
+			if (written < 0)
+			{
+				if (errno == EINTR) continue;
+				return false;
+			}
+			m_bytesWritten += written;
+
+			while (first < segments.size() && (size_t)written >= segments[first].iov_len)
+			{
+				written -= segments[first].iov_len;
+				++first;
+			}
+
+			if (first < segments.size())
+			{
+				segments[first].iov_base = static_cast<char*>(segments[first].iov_base) + written;
+				segments[first].iov_len -= written;
+			}
+		}
+
+		return true;
+	}
+
+	std::ostream& m_stream;
+	int m_fd;
+	bool m_async = false;
+	bool m_failed = false;
+	size_t m_bytesWritten = 0;
+	std::string m_buffer;
+	size_t m_bufferSegmentStart = 0;
+	std::vector<iovec> m_segments;
+	std::string m_inFlight;
+	std::future<bool> m_pending;
+};
@@ -0,0 +1,728 @@
+#include "PolySort.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_set>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "ByteScanning.h"
+#include "KeyPlan.h"
+
+PolySort::PolySort(const std::vector<ColIdentifier>& sortCols, std::istream& input, std::ostream& output)
+	: m_input(input), m_output(output), m_sortCols(sortCols)
+{}
+
+bool PolySort::Sort()
+{
+	size_t allocationsBefore = allocations();
+	bool sorted = sort();
+	if (m_stats) finishStats(allocationsBefore);
+	return sorted;
+}
+
+bool PolySort::SortInMemory()
+{
+	size_t allocationsBefore = allocations();
+	bool sorted = sortInMemory();
+	if (m_stats) finishStats(allocationsBefore);
+	return sorted;
+}
+
+const std::vector<RowIndex>& PolySort::GetPermutation() const
+{
+	return m_order;
+}
+
+std::vector<std::string_view> PolySort::GetSortedView() const
+{
+	std::vector<std::string_view> sorted;
+	sorted.reserve(m_order.size());
+	for (RowIndex row : m_order) sorted.push_back(m_lines[row]);
+	return sorted;
+}
+
+bool PolySort::sort()
+{
+	if (!initKeys()) return false;
+	if (m_topK) return sortTopK();
+	if (m_memoryBudget != 0) return sortExternal();
+
+	ReadInput();
+	if (!extractKeys(0)) return false;
+	SortLines();
+	return WriteOutput();
+}
+
+bool PolySort::sortInMemory()
+{
+	if (!initKeys()) return false;
+
+	ReadInput();
+	if (!extractKeys(0)) return false;
+	SortLines();
+
+	if (m_topK && m_order.size() > *m_topK) m_order.resize(*m_topK);
+	return true;
+}
+
+// Reads the whole input into the arena, unless it was given in memory, and
+// records where each line is.
+void PolySort::ReadInput()
+{
+	PhaseTimer timer(m_stats.get(), "read");
+	if (m_source == InputSource::Records)
+	{
+		m_lines = m_records;
+		m_inputPos = m_records.size();
+
+		if (m_stats)
+		{
+			for (auto record : m_records) m_stats->BytesRead += record.length();
+		}
+		return;
+	}
+
+	if (m_source == InputSource::Stream)
+	{
+		m_arena.Clear();
+		m_arena.ReadAll(m_input);
+		m_inputData = m_arena.View();
+	}
+
+	m_inputPos = m_inputData.length();
+	scanLines(m_inputData);
+
+	if (m_stats) m_stats->BytesRead += m_inputData.length();
+}
+
+bool PolySort::ExtractKeys()
+{
+	return initKeys() && extractKeys(0);
+}
+
+void PolySort::SortLines()
+{
+	PhaseTimer timer(m_stats.get(), "sort");
+	m_order.resize(m_lines.size());
+	for (size_t i = 0; i < m_order.size(); ++i) m_order[i] = (RowIndex)i;
+
+	if (m_unique && mostlyDuplicates()) removeDuplicatesByHash();
+	dispatchKeyPlan(m_keys, [this](const auto& plan)
+	{
+		if (m_stats) sortOrder(CountingKeyPlan(plan, m_stats->Comparisons));
+		else sortOrder(plan);
+	});
+}
+
+bool PolySort::WriteOutput()
+{
+	PhaseTimer timer(m_stats.get(), "write");
+	OutputWriter output(m_output, m_outputFd);
+	bool written = writeRun(output);
+
+	if (m_stats) m_stats->BytesWritten += output.BytesWritten();
+	return written;
+}
+
+void PolySort::SetSeparator(char delim)
+{
+	m_tokenSeparator = delim;
+}
+
+void PolySort::SetMemoryBudget(size_t bytes)
+{
+	m_memoryBudget = bytes;
+}
+
+void PolySort::SetInputData(std::string_view data)
+{
+	m_inputData = data;
+	m_source = InputSource::Data;
+}
+
+void PolySort::SetTopK(size_t count)
+{
+	m_topK = count;
+}
+
+void PolySort::SetUnique(bool unique)
+{
+	m_unique = unique;
+}
+
+void PolySort::SetJobs(size_t jobs)
+{
+	m_jobs = jobs != 0 ? jobs : std::max(1u, std::thread::hardware_concurrency());
+}
+
+void PolySort::SetOutputDescriptor(int fd)
+{
+	m_outputFd = fd;
+}
+
+void PolySort::SetTempDirectory(const std::string& dir)
+{
+	m_tempDir = dir;
+}
+
+void PolySort::EnableStats(size_t (*allocationCount)())
+{
+	m_stats = std::make_unique<SortStats>();
+	m_allocationCount = allocationCount;
+}
+
+const SortStats* PolySort::GetStats() const
+{
+	return m_stats.get();
+}
+
+const std::string& PolySort::GetMessage() const
+{
+	return m_message;
+}
+
+size_t PolySort::allocations() const
+{
+	return m_stats && m_allocationCount ? m_allocationCount() : 0;
+}
+
+void PolySort::finishStats(size_t allocationsBefore)
+{
+	if (m_allocationCount) m_stats->Allocations = m_allocationCount() - allocationsBefore;
+	m_stats->Runs = m_runStats;
+
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) m_stats->PeakMemoryKB = (size_t)usage.ru_maxrss;
+}
+
+bool PolySort::initKeys()
+{
+	for (auto& col : m_sortCols)
+	{
+		if (col.Type != 'S' && col.Type != 'N' && !isWideKeyType(col.Type))
+		{
+			m_message = "error: radka 0, sloupec " + std::to_string(col.Number) + " - nepodporovany typ hodnoty";
+			return false;
+		}
+	}
+
+	m_keys.Init(m_sortCols);
+	return true;
+}
+
+// Finds all lines of the text. Each job scans its own part of the text,
+// the parts being split right after a newline. The lines are counted first,
+// so that they are stored into one exactly sized array without reallocation.
+void PolySort::scanLines(std::string_view text)
+{
+	size_t jobs = jobsFor(text.length(), MinBytesPerJob);
+
+	std::vector<size_t> bounds{ 0 };
+	for (size_t job = 1; job < jobs; ++job)
+	{
+		size_t end = findByte(text, std::max(bounds.back(), text.length() * job / jobs), '\n');
+		bounds.push_back(std::min(end + 1, text.length()));
+	}
+	bounds.push_back(text.length());
+
+	std::vector<size_t> firsts(jobs + 1, 0);
+	parallelFor(jobs, jobs, [&](size_t job, size_t, size_t)
+	{
+		std::string_view part = text.substr(bounds[job], bounds[job + 1] - bounds[job]);
+		firsts[job + 1] = countByte(part, '\n') + (!part.empty() && part.back() != '\n');
+	});
+	for (size_t job = 0; job < jobs; ++job) firsts[job + 1] += firsts[job];
+
+	m_lines.resize(firsts.back());
+	parallelFor(jobs, jobs, [&](size_t job, size_t, size_t)
+	{
+		size_t partBegin = bounds[job];
+		size_t begin = partBegin;
+		std::string_view* line = m_lines.data() + firsts[job];
+		forEachByte(text.substr(partBegin, bounds[job + 1] - partBegin), '\n', [&](size_t pos)
+		{
+			*line++ = text.substr(begin, partBegin + pos - begin);
+			begin = partBegin + pos + 1;
+			return true;
+		});
+
+		if (begin < bounds[job + 1]) *line = text.substr(begin, bounds[job + 1] - begin);
+	});
+}
+
+// Number of jobs worth starting for the given amount of work.
+size_t PolySort::jobsFor(size_t work, size_t minPerJob) const
+{
+	return std::max<size_t>(1, std::min(m_jobs, work / minPerJob));
+}
+
+// Returns the next line of the input given in memory and moves past it. In
+// a buffer, follows std::getline semantics, so a trailing newline doesn't
+// produce an empty last line.
+std::string_view PolySort::nextLine()
+{
+	if (m_source == InputSource::Records) return m_records[m_inputPos++];
+
+	size_t begin = m_inputPos;
+	size_t end = findByte(m_inputData, begin, '\n');
+	m_inputPos = end + 1;
+	return m_inputData.substr(begin, end - begin);
+}
+
+bool PolySort::inputExhausted()
+{
+	switch (m_source)
+	{
+	case InputSource::Data: return m_inputPos >= m_inputData.length();
+	case InputSource::Records: return m_inputPos >= m_records.size();
+	default: return m_input.peek() == std::char_traits<char>::eof();
+	}
+}
+
+// Reads lines until the memory budget is used up. Lines of input given in
+// memory are referenced in place, otherwise they are copied into the arena.
+void PolySort::readRun()
+{
+	PhaseTimer timer(m_stats.get(), "read");
+	m_lines.clear();
+	size_t rowSize = sizeof(std::string_view) + sizeof(RowIndex) + m_keys.RowSize();
+
+	if (m_source != InputSource::Stream)
+	{
+		size_t runBytes = 0;
+		while (runBytes + m_lines.size() * rowSize < m_memoryBudget && !inputExhausted())
+		{
+			m_lines.push_back(nextLine());
+			runBytes += m_lines.back().length() + 1;
+		}
+
+		if (m_stats) m_stats->BytesRead += runBytes;
+		return;
+	}
+
+	// The arena may move while it grows, so the lines are only located once
+	// the whole run is in it.
+	m_arena.Clear();
+	std::string line;
+	size_t lines = 0;
+	while (m_arena.Size() + lines * rowSize < m_memoryBudget && std::getline(m_input, line))
+	{
+		char* dest = m_arena.Allocate(line.length() + 1);
+		std::memcpy(dest, line.data(), line.length());
+		dest[line.length()] = '\n';
+		++lines;
+	}
+	scanLines(m_arena.View());
+
+	if (m_stats) m_stats->BytesRead += m_arena.Size();
+}
+
+// Extracts the keys of the lines currently in memory. The first line is line
+// number firstLine of the whole input.
+bool PolySort::extractKeys(size_t firstLine)
+{
+	PhaseTimer timer(m_stats.get(), "keys");
+	if (m_lines.size() > std::numeric_limits<RowIndex>::max())
+	{
+		m_message = "error: prilis mnoho radek";
+		return false;
+	}
+
+	// Every job remembers the first line it failed on, so the error
+	// reported is the first one in the input regardless of the jobs.
+	size_t jobs = jobsFor(m_lines.size(), MinRowsPerJob);
+	std::vector<std::pair<size_t, size_t>> errors(jobs, { std::numeric_limits<size_t>::max(), 0 });
+
+	m_keys.Reset(m_lines.size());
+	parallelFor(jobs, m_lines.size(), [&](size_t job, size_t begin, size_t end)
+	{
+		std::vector<Slice> fields;
+		for (size_t i = begin; i < end; ++i)
+		{
+			size_t failedColumn = 0;
+			if (!m_keys.Extract((RowIndex)i, m_lines[i], m_tokenSeparator, fields, failedColumn))
+			{
+				errors[job] = { i, failedColumn };
+				return;
+			}
+		}
+	});
+
+	auto [failedLine, failedColumn] = *std::min_element(errors.begin(), errors.end());
+	if (failedLine != std::numeric_limits<size_t>::max())
+	{
+		m_message = "error: radka " + std::to_string(firstLine + failedLine) + ", sloupec " + std::to_string(failedColumn) + " - nepripustny format";
+		return false;
+	}
+
+	if (m_stats) m_stats->Lines += m_lines.size();
+	return true;
+}
+
+// Estimates the share of duplicates from lines spread evenly over the input.
+bool PolySort::mostlyDuplicates() const
+{
+	size_t samples = std::min(m_order.size(), DedupSampleRows);
+	if (samples == 0) return false;
+
+	auto hash = [this](RowIndex row) { return m_keys.Hash(row); };
+	auto equal = [this](RowIndex a, RowIndex b) { return m_keys.Compare(a, m_keys, b) == 0; };
+	std::unordered_set<RowIndex, decltype(hash), decltype(equal)> distinct(samples, hash, equal);
+	for (size_t i = 0; i < samples; ++i) distinct.insert(m_order[m_order.size() * i / samples]);
+
+	return (samples - distinct.size()) * 100 >= samples * HashDedupMinPercent;
+}
+
+// Keeps only the first line of every key in m_order, which is still in input
+// order, so that the duplicates don't take part in the sort at all.
+void PolySort::removeDuplicatesByHash()
+{
+	auto hash = [this](RowIndex row) { return m_keys.Hash(row); };
+	auto equal = [this](RowIndex a, RowIndex b) { return m_keys.Compare(a, m_keys, b) == 0; };
+	std::unordered_set<RowIndex, decltype(hash), decltype(equal)> seen(0, hash, equal);
+
+	size_t kept = 0;
+	for (RowIndex row : m_order)
+	{
+		if (seen.insert(row).second) m_order[kept++] = row;
+	}
+	m_order.resize(kept);
+}
+
+// Sorts the whole permutation with the comparator of the given key plan. In
+// the unique mode, only the first line of each group of equal keys is kept,
+// which the stable sort leaves at the front of the group.
+template <typename Plan>
+void PolySort::sortOrder(const Plan& plan)
+{
+	auto less = [&plan](RowIndex a, RowIndex b) { return plan.Compare(a, b) < 0; };
+	std::mutex statsMutex;
+	auto sortChunk = [this, &plan, &less, &statsMutex](RowIndex* begin, RowIndex* end)
+	{
+		RunStats stats = sortRows(begin, end, plan, less);
+		std::lock_guard<std::mutex> lock(statsMutex);
+		m_runStats += stats;
+	};
+	parallelStableSort(m_order, jobsFor(m_order.size(), MinRowsPerJob), sortChunk, less);
+
+	if (m_unique)
+	{
+		auto equal = [&plan](RowIndex a, RowIndex b) { return plan.Compare(a, b) == 0; };
+		m_order.erase(std::unique(m_order.begin(), m_order.end(), equal), m_order.end());
+	}
+}
+
+// Stable sort of a part of the permutation. Mostly sorted parts are sorted
+// by merging their natural runs. Otherwise leading integer columns are radix
+// sorted, any remaining columns are then sorted by comparison within the
+// groups of rows whose integer keys are equal.
+template <typename Plan, typename Less>
+RunStats PolySort::sortRows(RowIndex* begin, RowIndex* end, const Plan& plan, Less& less) const
+{
+	RunStats stats;
+	if (naturalMergeSort(begin, end, less, stats)) return stats;
+
+	std::vector<const KeyColumn*> integers;
+	for (auto& col : m_keys.Columns())
+	{
+		if (!col.IsInteger()) break;
+		integers.push_back(&col);
+	}
+
+	if (integers.empty() || (size_t)(end - begin) < RadixMinRows)
+	{
+		std::stable_sort(begin, end, less);
+		return stats;
+	}
+
+	radixSort(begin, end - begin, integers);
+
+	size_t columns = m_keys.Columns().size();
+	if (integers.size() == columns) return stats;
+
+	auto lessRest = [&plan, prefix = integers.size()](RowIndex a, RowIndex b) { return plan.Compare(a, b, prefix) < 0; };
+	for (RowIndex* group = begin; group != end;)
+	{
+		RowIndex* groupEnd = group + 1;
+		while (groupEnd != end && m_keys.CompareColumns(*group, *groupEnd, 0, integers.size()) == 0) ++groupEnd;
+		if (groupEnd - group > 1) std::stable_sort(group, groupEnd, lessRest);
+		group = groupEnd;
+	}
+
+	return stats;
+}
+
+// The lines stay in memory until the output is flushed, so the writer may
+// reference them instead of copying.
+bool PolySort::writeRun(OutputWriter& output)
+{
+	size_t jobs = jobsFor(m_order.size(), MinRowsPerJob);
+	if (jobs == 1)
+	{
+		for (RowIndex row : m_order) output.WriteLine(m_lines[row], true);
+
+		return checkWritten(output);
+	}
+
+	// The lines are gathered into one buffer per job in batches and the
+	// buffers are written out in order, before the next batch reuses them.
+	std::vector<std::string> buffers(jobs);
+	for (size_t first = 0; first < m_order.size(); first += jobs * OutputBatchRows)
+	{
+		for (auto& buffer : buffers) buffer.clear();
+
+		size_t count = std::min(jobs * OutputBatchRows, m_order.size() - first);
+		parallelFor(jobs, count, [&](size_t job, size_t begin, size_t end)
+		{
+			std::string& buffer = buffers[job];
+			for (size_t i = first + begin; i < first + end; ++i)
+			{
+				buffer.append(m_lines[m_order[i]]).push_back('\n');
+			}
+		});
+
+		for (auto& buffer : buffers) output.Write(buffer, true);
+		output.Flush();
+	}
+
+	return checkWritten(output);
+}
+
+bool PolySort::checkWritten(OutputWriter& output)
+{
+	if (!output.Flush())
+	{
+		m_message = "error: zapis selhal";
+		return false;
+	}
+
+	return true;
+}
+
+// Sorts the input in runs that fit into the memory budget, spills them to
+// temporary files and merges them into the output.
+bool PolySort::sortExternal()
+{
+	std::vector<TempFile> runs;
+	size_t firstLine = 0;
+
+	while (true)
+	{
+		readRun();
+		if (m_lines.empty()) break;
+		if (!extractKeys(firstLine)) return false;
+		SortLines();
+		firstLine += m_lines.size();
+
+		// Input that fits into a single run doesn't need the temporary files.
+		if (runs.empty() && inputExhausted()) return WriteOutput();
+
+		PhaseTimer timer(m_stats.get(), "spill");
+		std::optional<TempFile> file = createTempFile();
+		if (!file) return false;
+		std::ofstream out(file->Path(), std::ios::binary);
+		OutputWriter writer(out);
+		if (!writeRun(writer)) return false;
+		runs.push_back(std::move(*file));
+
+		if (m_stats) m_stats->BytesSpilled += writer.BytesWritten();
+	}
+
+	m_arena.Free();
+	m_lines = std::vector<std::string_view>();
+	m_order = std::vector<RowIndex>();
+
+	PhaseTimer timer(m_stats.get(), "merge");
+	while (runs.size() > MaxMergeWidth)
+	{
+		std::vector<TempFile> merged;
+		for (size_t i = 0; i < runs.size(); i += MaxMergeWidth)
+		{
+			std::optional<TempFile> file = createTempFile();
+			if (!file) return false;
+			std::ofstream out(file->Path(), std::ios::binary);
+			OutputWriter writer(out);
+			if (!mergeRuns(runs, i, std::min(runs.size(), i + MaxMergeWidth), writer)) return false;
+			merged.push_back(std::move(*file));
+
+			if (m_stats) m_stats->BytesSpilled += writer.BytesWritten();
+		}
+		runs = std::move(merged);
+	}
+
+	// The final merge overlaps with writing its output.
+	OutputWriter output(m_output, m_outputFd);
+	output.StartAsync();
+	bool merged = mergeRuns(runs, 0, runs.size(), output);
+
+	if (m_stats) m_stats->BytesWritten += output.BytesWritten();
+	return merged;
+}
+
+// Merges runs [begin, end) into the output. Lines with equal keys are
+// taken from the earlier run first, which keeps the sort stable. In the
+// unique mode, lines with the same keys as the last line written are
+// skipped, so only the first one in the input remains.
+bool PolySort::mergeRuns(const std::vector<TempFile>& runs, size_t begin, size_t end, OutputWriter& output)
+{
+	std::vector<std::unique_ptr<RunReader>> readers;
+	for (size_t i = begin; i < end; ++i)
+	{
+		readers.push_back(std::make_unique<RunReader>(runs[i].Path(), m_sortCols, m_tokenSeparator));
+	}
+
+	auto later = [this, &readers](size_t a, size_t b)
+	{
+		if (m_stats) ++m_stats->Comparisons;
+		int cmp = readers[a]->Current().Compare(readers[b]->Current());
+		return cmp != 0 ? cmp > 0 : a > b;
+	};
+	std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heads(later);
+
+	for (size_t i = 0; i < readers.size(); ++i)
+	{
+		if (readers[i]->Next()) heads.push(i);
+	}
+
+	KeyedLine last(m_sortCols);
+	bool hasLast = false;
+	while (!heads.empty())
+	{
+		size_t top = heads.top();
+		heads.pop();
+
+		const KeyedLine& current = readers[top]->Current();
+		if (!m_unique || !hasLast || current.Compare(last) != 0)
+		{
+			output.WriteLine(current.Line());
+			if (m_unique)
+			{
+				size_t failedColumn = 0;
+				last.Line() = current.Line();
+				last.Parse(m_tokenSeparator, failedColumn);
+				hasLast = true;
+			}
+		}
+
+		if (readers[top]->Next()) heads.push(top);
+	}
+
+	return checkWritten(output);
+}
+
+// Reads the next line of the input into line, returns false at its end.
+bool PolySort::readLine(std::string& line)
+{
+	if (m_source == InputSource::Stream)
+	{
+		if (!std::getline(m_input, line)) return false;
+	}
+	else
+	{
+		if (inputExhausted()) return false;
+		line.assign(nextLine());
+	}
+
+	if (m_stats) m_stats->BytesRead += line.length() + 1;
+	return true;
+}
+
+// Keeps the first m_topK lines of the sorted order in a max-heap while
+// streaming the input. A line replaces the top of the heap only if it
+// sorts before it, with ties going to the earlier line, so the result is
+// the same as the beginning of the full stable sort. In the unique mode, the
+// keys in the heap are also kept in a hash set and a line whose keys are
+// already there is dropped, as the line in the heap came first.
+bool PolySort::sortTopK()
+{
+	struct Entry
+	{
+		std::unique_ptr<KeyedLine> Line;
+		size_t Number;
+	};
+
+	auto before = [this](const Entry& a, const Entry& b)
+	{
+		if (m_stats) ++m_stats->Comparisons;
+		int cmp = a.Line->Compare(*b.Line);
+		return cmp != 0 ? cmp < 0 : a.Number < b.Number;
+	};
+
+	auto hash = [](const KeyedLine* line) { return line->Hash(); };
+	auto equal = [](const KeyedLine* a, const KeyedLine* b) { return a->Compare(*b) == 0; };
+	std::unordered_set<const KeyedLine*, decltype(hash), decltype(equal)> heapKeys(0, hash, equal);
+
+	PhaseTimer timer(m_stats.get(), "top-k");
+	std::vector<Entry> heap;
+	heap.reserve(*m_topK);
+	Entry candidate{ std::make_unique<KeyedLine>(m_sortCols), 0 };
+
+	size_t lineNum = 0;
+	for (; readLine(candidate.Line->Line()); ++lineNum)
+	{
+		size_t failedColumn = 0;
+		if (!candidate.Line->Parse(m_tokenSeparator, failedColumn))
+		{
+			m_message = "error: radka " + std::to_string(lineNum) + ", sloupec " + std::to_string(failedColumn) + " - nepripustny format";
+			return false;
+		}
+		candidate.Number = lineNum;
+
+		if (m_unique && heapKeys.count(candidate.Line.get()) != 0) continue;
+
+		if (heap.size() < *m_topK)
+		{
+			if (m_unique) heapKeys.insert(candidate.Line.get());
+			heap.push_back(std::move(candidate));
+			std::push_heap(heap.begin(), heap.end(), before);
+			candidate = { std::make_unique<KeyedLine>(m_sortCols), 0 };
+		}
+		else if (!heap.empty() && before(candidate, heap.front()))
+		{
+			std::pop_heap(heap.begin(), heap.end(), before);
+			if (m_unique)
+			{
+				heapKeys.erase(heap.back().Line.get());
+				heapKeys.insert(candidate.Line.get());
+			}
+			std::swap(candidate, heap.back());
+			std::push_heap(heap.begin(), heap.end(), before);
+		}
+	}
+
+	std::sort_heap(heap.begin(), heap.end(), before);
+	OutputWriter output(m_output, m_outputFd);
+	for (auto& entry : heap) output.WriteLine(entry.Line->Line(), true);
+	bool written = checkWritten(output);
+
+	if (m_stats)
+	{
+		m_stats->Lines += lineNum;
+		m_stats->BytesWritten += output.BytesWritten();
+	}
+	return written;
+}
+
+std::optional<TempFile> PolySort::createTempFile()
+{
+	std::error_code ec;
+	std::filesystem::path dir = m_tempDir.empty() ? std::filesystem::temp_directory_path(ec) : std::filesystem::path(m_tempDir);
+	std::filesystem::path path = dir / ("polysort-" + std::to_string(getpid()) + "-" + std::to_string(m_tempCounter++) + ".run");
+
+	std::ofstream file(path, std::ios::binary);
+	if (ec || !file)
+	{
+		m_message = "error: nelze vytvorit docasny soubor";
+		return std::nullopt;
+	}
+
+	return TempFile(path);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Arena.h"
+#include "ExternalSort.h"
+#include "KeyStore.h"
+#include "OutputWriter.h"
+#include "SortAlgorithms.h"
+#include "SortStats.h"
+#include "Utilities.h"
+
+// Sorts lines by typed key columns. The input is a stream, a buffer of
+// newline separated lines or a sequence of records already in memory. The
+// result is either written to the output, or kept as a permutation of the
+// input lines for the caller to use.
+class PolySort
+{
+public:
+	PolySort(const std::vector<ColIdentifier>& sortCols, std::istream& input = std::cin, std::ostream& output = std::cout);
+
+	// Sorts the input and writes the sorted lines to the output.
+	bool Sort();
+
+	// Sorts the input in memory without writing anything, the result is then
+	// available from GetPermutation and GetSortedView. The memory budget
+	// doesn't apply, the top-K mode only cuts the result short.
+	bool SortInMemory();
+
+	// Indices of the input lines in the sorted order, after SortInMemory.
+	// Without the unique or top-K mode, it's a permutation of all lines.
+	const std::vector<RowIndex>& GetPermutation() const;
+
+	// The lines in the sorted order, after SortInMemory. They point into the
+	// input given in memory, or into the sorter's own copy of an input
+	// stream, which lives until the next sort or the sorter's destruction.
+	std::vector<std::string_view> GetSortedView() const;
+
+	// The phases of the in-memory sort, which Sort() runs in this order when
+	// neither the top-K mode nor the memory budget is set. They're exposed so
+	// that the phases can be measured separately.
+	void ReadInput();
+	bool ExtractKeys();
+	void SortLines();
+	bool WriteOutput();
+
+	void SetSeparator(char delim);
+
+	// Limits the memory used for lines and keys to roughly the given number
+	// of bytes. Inputs that don't fit are sorted in runs that get spilled to
+	// temporary files and merged. Zero (the default) sorts in memory.
+	void SetMemoryBudget(size_t bytes);
+
+	// Sorts the given buffer instead of reading the input stream. The lines
+	// and keys point directly into it, so it has to outlive the sort.
+	void SetInputData(std::string_view data);
+
+	// Sorts the given records instead of reading the input stream, each one
+	// being a line on its own. Only the views are copied, the records have to
+	// outlive the sort. A record may contain newlines only if it's sorted in
+	// memory, as the runs of the external sort are split at newlines.
+	template <typename Iterator>
+	void SetInputRecords(Iterator begin, Iterator end)
+	{
+		m_records.assign(begin, end);
+		m_source = InputSource::Records;
+	}
+
+	// Only outputs the first count lines of the sorted output. The input is
+	// streamed through a heap of that many lines, so the whole input is never
+	// held in memory and the memory budget and jobs don't apply.
+	void SetTopK(size_t count);
+
+	// Only outputs the first of the lines whose keys are all equal, that is
+	// the one that comes first in the input.
+	void SetUnique(bool unique);
+
+	// Number of threads used for parsing, sorting and output, one by default.
+	// Zero uses all hardware threads. The output doesn't depend on it.
+	void SetJobs(size_t jobs);
+
+	// Writes the output directly to the file descriptor instead of the output
+	// stream, which allows large unbuffered writes. The descriptor isn't closed.
+	void SetOutputDescriptor(int fd);
+
+	// Directory for the runs of the external sort, the system one by default.
+	void SetTempDirectory(const std::string& dir);
+
+	// Collects timings and counters from now on, at some cost in speed. The
+	// stats are complete once Sort() returns. Allocations are only counted
+	// with a function returning the number of allocations so far, like the
+	// one of AllocationCounter.h.
+	void EnableStats(size_t (*allocationCount)() = nullptr);
+
+	// The collected stats, or null if they aren't enabled.
+	const SortStats* GetStats() const;
+
+	const std::string& GetMessage() const;
+
+private:
+	enum class InputSource
+	{
+		Stream,
+		Data,
+		Records
+	};
+
+	// Maximum number of runs merged at once, keeps the number of open files
+	// bounded. More runs get merged in several rounds.
+	static constexpr size_t MaxMergeWidth = 64;
+
+	// Smallest amount of work worth giving to a separate thread.
+	static constexpr size_t MinRowsPerJob = 1024;
+	static constexpr size_t MinBytesPerJob = 64 * 1024;
+
+	// Below this many lines, comparison sorting beats the radix passes.
+	static constexpr size_t RadixMinRows = 256;
+
+	// Number of lines each job gathers for a single write of the output.
+	static constexpr size_t OutputBatchRows = 16 * 1024;
+
+	// In the unique mode, duplicates are removed by hashing before sorting
+	// when at least this percentage of a sample of the lines are duplicates.
+	static constexpr size_t DedupSampleRows = 4096;
+	static constexpr size_t HashDedupMinPercent = 50;
+
+	bool sort();
+	bool sortInMemory();
+	size_t allocations() const;
+	void finishStats(size_t allocationsBefore);
+	bool initKeys();
+	void scanLines(std::string_view text);
+	size_t jobsFor(size_t work, size_t minPerJob) const;
+	std::string_view nextLine();
+	bool inputExhausted();
+	void readRun();
+	bool extractKeys(size_t firstLine);
+	bool mostlyDuplicates() const;
+	void removeDuplicatesByHash();
+	template <typename Plan>
+	void sortOrder(const Plan& plan);
+	template <typename Plan, typename Less>
+	RunStats sortRows(RowIndex* begin, RowIndex* end, const Plan& plan, Less& less) const;
+	bool writeRun(OutputWriter& output);
+	bool checkWritten(OutputWriter& output);
+	bool sortExternal();
+	bool mergeRuns(const std::vector<TempFile>& runs, size_t begin, size_t end, OutputWriter& output);
+	bool readLine(std::string& line);
+	bool sortTopK();
+	std::optional<TempFile> createTempFile();
+
+	char m_tokenSeparator = ' ';
+	size_t m_memoryBudget = 0;
+	std::optional<size_t> m_topK;
+	bool m_unique = false;
+	size_t m_jobs = 1;
+	std::string m_tempDir;
+	size_t m_tempCounter = 0;
+	InputSource m_source = InputSource::Stream;
+	std::string_view m_inputData;
+	std::vector<std::string_view> m_records;
+	size_t m_inputPos = 0;
+	Arena m_arena;
+	std::vector<std::string_view> m_lines;
+	std::vector<RowIndex> m_order;
+	KeyStore m_keys;
+	std::istream& m_input;
+	std::ostream& m_output;
+	int m_outputFd = -1;
+	std::vector<ColIdentifier> m_sortCols;
+	RunStats m_runStats;
+	std::unique_ptr<SortStats> m_stats;
+	size_t (*m_allocationCount)() = nullptr;
+
+	std::string m_message;
+};
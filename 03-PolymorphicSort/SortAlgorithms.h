@@ -0,0 +1,321 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "KeyStore.h"
+#include "Utilities.h"
+
+// Stable LSD radix pass over all bytes of a single column of signed keys,
+// with the sign bit flipped so that the unsigned order of the keys matches
+// the signed one. Bytes that are the same for all rows are skipped.
+template <typename T>
+void radixSortColumn(RowIndex* rows, size_t count, const std::vector<T>& keys)
+{
+	using Unsigned = std::make_unsigned_t<T>;
+	constexpr size_t Bytes = sizeof(Unsigned);
+	constexpr Unsigned SignBit = Unsigned(1) << (8 * Bytes - 1);
+
+	struct Item
+	{
+		Unsigned Key;
+		RowIndex Row;
+	};
+
+	std::vector<Item> items(count);
+	std::vector<Item> buffer(count);
+
+	std::vector<std::array<size_t, 256>> counts(Bytes);
+	for (size_t i = 0; i < count; ++i)
+	{
+		Unsigned key = (Unsigned)keys[rows[i]] ^ SignBit;
+		items[i] = { key, rows[i] };
+		for (size_t byte = 0; byte < Bytes; ++byte) ++counts[byte][(key >> (8 * byte)) & 0xFF];
+	}
+
+	for (size_t byte = 0; byte < Bytes; ++byte)
+	{
+		unsigned shift = 8 * byte;
+		if (counts[byte][(items[0].Key >> shift) & 0xFF] == count) continue;
+
+		size_t offsets[256];
+		size_t offset = 0;
+		for (size_t digit = 0; digit < 256; ++digit)
+		{
+			offsets[digit] = offset;
+			offset += counts[byte][digit];
+		}
+
+		for (const Item& item : items) buffer[offsets[(item.Key >> shift) & 0xFF]++] = item;
+		items.swap(buffer);
+	}
+
+	for (size_t i = 0; i < count; ++i) rows[i] = items[i].Row;
+}
+
+// Stable LSD radix sort of rows by integer key columns, the first column
+// being the most significant. N columns take four counting passes, the
+// 64-bit key types eight.
+inline void radixSort(RowIndex* rows, size_t count, const std::vector<const KeyColumn*>& columns)
+{
+	for (size_t col = columns.size(); col-- > 0;)
+	{
+		if (columns[col]->Storage() == KeyStorage::Narrow) radixSortColumn(rows, count, columns[col]->Numbers());
+		else radixSortColumn(rows, count, columns[col]->WideNumbers());
+	}
+}
+
+// Statistics of the natural runs found by naturalMergeSort.
+struct RunStats
+{
+	// Parts of the input checked for runs, and how many of them were sorted
+	// by merging their runs.
+	size_t Chunks = 0;
+	size_t MergedChunks = 0;
+
+	// Natural runs of the merged chunks and the longest of them.
+	size_t Runs = 0;
+	size_t LongestRun = 0;
+
+	RunStats& operator+= (const RunStats& other)
+	{
+		Chunks += other.Chunks;
+		MergedChunks += other.MergedChunks;
+		Runs += other.Runs;
+		LongestRun = std::max(LongestRun, other.LongestRun);
+		return *this;
+	}
+};
+
+// Runs shorter than this are extended by binary insertion before merging.
+constexpr size_t MinRunLength = 32;
+
+// Merging natural runs only pays off if they are at least this long on
+// average, otherwise sorting from scratch is faster.
+constexpr size_t MinAverageRunLength = 16;
+
+namespace detail
+{
+	// Stable merge of the adjacent sorted ranges [begin, mid) and [mid, end).
+	// The elements already in place at either end are skipped using binary
+	// search, so ranges that are in order cost a single comparison.
+	template <typename T, typename Less>
+	void mergeAdjacent(T* begin, T* mid, T* end, Less& less, std::vector<T>& buffer)
+	{
+		if (!less(*mid, *(mid - 1))) return;
+
+		begin = std::upper_bound(begin, mid, *mid, less);
+		end = std::lower_bound(mid, end, *(mid - 1), less);
+
+		buffer.assign(begin, mid);
+		T* a = buffer.data();
+		T* aEnd = a + buffer.size();
+		T* b = mid;
+		T* out = begin;
+		while (a != aEnd && b != end) *out++ = less(*b, *a) ? *b++ : *a++;
+		std::copy(a, aEnd, out);
+	}
+
+	// Power of the boundary between the runs [begin, begin + length1) and
+	// [begin + length1, begin + length1 + length2) of a range of count
+	// elements: the depth at which the boundary would be in a perfectly
+	// balanced merge tree. Computed bitwise from the midpoints of the runs,
+	// as in CPython's listsort.
+	inline int runPower(size_t begin, size_t length1, size_t length2, size_t count)
+	{
+		size_t a = 2 * begin + length1;
+		size_t b = a + length1 + length2;
+		int power = 0;
+		while (true)
+		{
+			++power;
+			if (a >= count)
+			{
+				a -= count;
+				b -= count;
+			}
+			else if (b >= count)
+			{
+				break;
+			}
+			a <<= 1;
+			b <<= 1;
+		}
+
+		return power;
+	}
+}
+
+// Stable sort for presorted input, in the style of powersort. The range is
+// split into natural non-descending runs, runs shorter than MinRunLength are
+// extended by binary insertion, and neighbouring runs are merged in the order
+// given by the powers of their boundaries. Runs that are already in order
+// relative to each other cost a single comparison, so sorted input takes
+// linear time.
+// Returns false without touching the range if the runs are too short on
+// average for this to beat a regular sort.
+template <typename T, typename Less>
+bool naturalMergeSort(T* begin, T* end, Less& less, RunStats& stats)
+{
+	size_t count = end - begin;
+	++stats.Chunks;
+	if (count < 2) return false;
+
+	size_t maxRuns = std::max<size_t>(1, count / MinAverageRunLength);
+	size_t runs = 1;
+	for (T* it = begin + 1; it != end; ++it)
+	{
+		if (less(*it, *(it - 1)) && ++runs > maxRuns) return false;
+	}
+
+	++stats.MergedChunks;
+	stats.Runs += runs;
+
+	struct Run
+	{
+		size_t Begin;
+		size_t Length;
+		int Power;
+	};
+
+	std::vector<Run> stack;
+	std::vector<T> buffer;
+	auto mergeTop = [&]()
+	{
+		Run& a = stack[stack.size() - 2];
+		Run& b = stack.back();
+		detail::mergeAdjacent(begin + a.Begin, begin + b.Begin, begin + b.Begin + b.Length, less, buffer);
+		a.Length += b.Length;
+		stack.pop_back();
+	};
+
+	for (size_t runBegin = 0; runBegin < count;)
+	{
+		size_t runEnd = runBegin + 1;
+		while (runEnd < count && !less(begin[runEnd], begin[runEnd - 1])) ++runEnd;
+		stats.LongestRun = std::max(stats.LongestRun, runEnd - runBegin);
+
+		for (size_t extendedEnd = std::min(count, runBegin + MinRunLength); runEnd < extendedEnd; ++runEnd)
+		{
+			T value = begin[runEnd];
+			T* pos = std::upper_bound(begin + runBegin, begin + runEnd, value, less);
+			std::move_backward(pos, begin + runEnd, begin + runEnd + 1);
+			*pos = value;
+		}
+
+		if (!stack.empty())
+		{
+			int power = detail::runPower(stack.back().Begin, stack.back().Length, runEnd - runBegin, count);
+			while (stack.size() > 1 && stack[stack.size() - 2].Power > power) mergeTop();
+			stack.back().Power = power;
+		}
+
+		stack.push_back({ runBegin, runEnd - runBegin, 0 });
+		runBegin = runEnd;
+	}
+
+	while (stack.size() > 1) mergeTop();
+	return true;
+}
+
+// Returns how many of the first count elements of the stable merge of a and b
+// come from a, so that merging can be split into independent pieces.
+template <typename T, typename Less>
+size_t mergeSplit(const T* a, size_t lenA, const T* b, size_t lenB, size_t count, Less& less)
+{
+	size_t lo = count > lenB ? count - lenB : 0;
+	size_t hi = std::min(count, lenA);
+	while (lo < hi)
+	{
+		size_t i = lo + (hi - lo) / 2;
+
+		// Ties are taken from a first, so a[i] still belongs to the first
+		// count elements unless b[count - i - 1] is strictly smaller.
+		if (!less(b[count - i - 1], a[i])) lo = i + 1;
+		else hi = i;
+	}
+
+	return lo;
+}
+
+// Stable sort that sorts one chunk per job with sortChunk(begin, end) and
+// then merges neighbouring chunks in rounds. Every merge is split into pieces
+// so that all jobs stay busy even in the last rounds. As long as sortChunk is
+// a stable sort by less, the result is identical to std::stable_sort.
+template <typename T, typename SortChunk, typename Less>
+void parallelStableSort(std::vector<T>& items, size_t jobs, SortChunk sortChunk, Less less)
+{
+	size_t count = items.size();
+	jobs = std::min(jobs, count);
+	if (jobs <= 1)
+	{
+		sortChunk(items.data(), items.data() + count);
+		return;
+	}
+
+	std::vector<size_t> bounds;
+	for (size_t job = 0; job <= jobs; ++job) bounds.push_back(count * job / jobs);
+
+	parallelFor(jobs, jobs, [&](size_t, size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; ++chunk)
+		{
+			sortChunk(items.data() + bounds[chunk], items.data() + bounds[chunk + 1]);
+		}
+	});
+
+	struct MergePiece
+	{
+		size_t ABegin, AEnd, BBegin, BEnd, Out;
+	};
+
+	std::vector<T> buffer(count);
+	T* src = items.data();
+	T* dst = buffer.data();
+	while (bounds.size() > 2)
+	{
+		size_t pairs = (bounds.size() - 1) / 2;
+		size_t piecesPerPair = std::max<size_t>(1, jobs / pairs);
+
+		std::vector<MergePiece> pieces;
+		std::vector<size_t> merged;
+		for (size_t chunk = 0; chunk + 1 < bounds.size(); chunk += 2)
+		{
+			merged.push_back(bounds[chunk]);
+
+			size_t a = bounds[chunk];
+			size_t b = bounds[std::min(chunk + 1, bounds.size() - 1)];
+			size_t end = bounds[std::min(chunk + 2, bounds.size() - 1)];
+			size_t total = end - a;
+
+			size_t prevCount = 0;
+			size_t prevSplit = 0;
+			for (size_t piece = 1; piece <= piecesPerPair; ++piece)
+			{
+				size_t pieceCount = total * piece / piecesPerPair;
+				size_t split = mergeSplit(src + a, b - a, src + b, end - b, pieceCount, less);
+				pieces.push_back({ a + prevSplit, a + split, b + prevCount - prevSplit, b + pieceCount - split, a + prevCount });
+				prevCount = pieceCount;
+				prevSplit = split;
+			}
+		}
+		merged.push_back(count);
+
+		parallelFor(jobs, pieces.size(), [&](size_t, size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				const MergePiece& piece = pieces[i];
+				std::merge(src + piece.ABegin, src + piece.AEnd, src + piece.BBegin, src + piece.BEnd, dst + piece.Out, less);
+			}
+		});
+
+		bounds = std::move(merged);
+		std::swap(src, dst);
+	}
+
+	if (src != items.data()) items.swap(buffer);
+}
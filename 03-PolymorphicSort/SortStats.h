@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SortAlgorithms.h"
+
+// Counters and timings of a sort. They are only collected once enabled with
+// PolySort::EnableStats, otherwise none of this code runs.
+struct SortStats
+{
+	// Milliseconds spent in each phase, in the order the phases first ran.
+	// Phases that run repeatedly, like those of every run of the external
+	// sort, are summed up.
+	std::vector<std::pair<std::string, double>> Phases;
+
+	size_t Lines = 0;
+	size_t BytesRead = 0;
+	size_t BytesWritten = 0;
+	size_t BytesSpilled = 0;
+
+	// Counted from several threads at once.
+	std::atomic<size_t> Comparisons{ 0 };
+
+	size_t Allocations = 0;
+	size_t PeakMemoryKB = 0;
+	RunStats Runs;
+
+	void AddPhase(const std::string& name, double milliseconds)
+	{
+		for (auto& phase : Phases)
+		{
+			if (phase.first == name)
+			{
+				phase.second += milliseconds;
+				return;
+			}
+		}
+
+		Phases.emplace_back(name, milliseconds);
+	}
+
+	void WriteText(std::ostream& out) const
+	{
+		for (auto& [name, milliseconds] : Phases) out << "phase " << name << ": " << milliseconds << " ms\n";
+
+		out << "lines: " << Lines << '\n'
+			<< "bytes read: " << BytesRead << '\n'
+			<< "bytes written: " << BytesWritten << '\n'
+			<< "bytes spilled: " << BytesSpilled << '\n'
+			<< "comparisons: " << Comparisons << '\n'
+			<< "allocations: " << Allocations << '\n'
+			<< "peak memory: " << PeakMemoryKB << " KB\n"
+			<< "runs: " << Runs.Runs << " natural runs in " << Runs.MergedChunks << " of " << Runs.Chunks
+			<< " chunks merged, longest " << Runs.LongestRun << " lines\n";
+	}
+
+	void WriteJson(std::ostream& out) const
+	{
+		out << "{\n  \"phases_ms\": {";
+		for (size_t i = 0; i < Phases.size(); ++i)
+		{
+			out << (i != 0 ? ", " : " ") << '"' << Phases[i].first << "\": " << Phases[i].second;
+		}
+
+		out << " },\n"
+			<< "  \"lines\": " << Lines << ",\n"
+			<< "  \"bytes_read\": " << BytesRead << ",\n"
+			<< "  \"bytes_written\": " << BytesWritten << ",\n"
+			<< "  \"bytes_spilled\": " << BytesSpilled << ",\n"
+			<< "  \"comparisons\": " << Comparisons << ",\n"
+			<< "  \"allocations\": " << Allocations << ",\n"
+			<< "  \"peak_memory_kb\": " << PeakMemoryKB << ",\n"
+			<< "  \"runs\": { \"chunks\": " << Runs.Chunks << ", \"merged_chunks\": " << Runs.MergedChunks
+			<< ", \"natural_runs\": " << Runs.Runs << ", \"longest_run\": " << Runs.LongestRun << " }\n"
+			<< "}\n";
+	}
+};
+
+// Adds the time from its construction to its destruction to a phase of the
+// stats. Does nothing without stats.
+class PhaseTimer
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	PhaseTimer(SortStats* stats, const char* phase)
+		: m_stats(stats), m_phase(phase)
+	{
+		if (m_stats) m_start = Clock::now();
+	}
+
+	PhaseTimer(const PhaseTimer&) = delete;
+	PhaseTimer& operator= (const PhaseTimer&) = delete;
+
+	~PhaseTimer()
+	{
+		if (m_stats) m_stats->AddPhase(m_phase, std::chrono::duration<double, std::milli>(Clock::now() - m_start).count());
+	}
+
+private:
+	SortStats* m_stats;
+	const char* m_phase;
+	Clock::time_point m_start;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+inline std::optional<int32_t> strToInt(std::string_view num)
+{
+	size_t parsed = 0;
+	auto [ptr, ec] { std::from_chars(num.data(), num.data() + num.size(), parsed) };
+
+	if (ec != std::errc() || ptr != num.data() + num.size()) return std::nullopt;
+
+	return parsed;
+}
+
+// Parses a byte count with an optional K, M or G suffix (powers of 1024).
+inline std::optional<size_t> parseSize(std::string_view size)
+{
+	size_t multiplier = 1;
+	if (!size.empty())
+	{
+		switch (size.back())
+		{
+		case 'K': multiplier = size_t(1) << 10; break;
+		case 'M': multiplier = size_t(1) << 20; break;
+		case 'G': multiplier = size_t(1) << 30; break;
+		default: break;
+		}
+		if (multiplier != 1) size.remove_suffix(1);
+	}
+
+	size_t parsed = 0;
+	auto [ptr, ec] { std::from_chars(size.data(), size.data() + size.size(), parsed) };
+
+	if (ec != std::errc() || ptr != size.data() + size.size()) return std::nullopt;
+	if (parsed > std::numeric_limits<size_t>::max() / multiplier) return std::nullopt;
+
+	return parsed * multiplier;
+}
+
+// A byte range inside a line, as found for the fields of the sort columns.
+struct Slice
+{
+	size_t Offset;
+	size_t Length;
+};
+
+// A sort column given on the command line, e.g. S2 or N1.
+struct ColIdentifier
+{
+	char Type;
+	size_t Number;
+};
+
+// Splits [0, count) into one contiguous part per job and calls
+// f(job, begin, end) for each part on its own thread. A single job runs on
+// the calling thread.
+template <typename F>
+void parallelFor(size_t jobs, size_t count, F&& f)
+{
+	jobs = std::max<size_t>(1, std::min(jobs, count));
+	if (jobs == 1)
+	{
+		f(0, 0, count);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	for (size_t job = 0; job < jobs; ++job)
+	{
+		threads.emplace_back([&f, job, begin = count * job / jobs, end = count * (job + 1) / jobs]() { f(job, begin, end); });
+	}
+	for (auto& thread : threads) thread.join();
+}
@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ArgParser.h"
+#include "PolySort.h"
+
+// Benchmark of the in-memory sort on synthetic inputs. Every case runs in its
+// own process, so the peak RSS reported belongs to that case only.
+//
+// Usage: PolySortBench [-n lines] [-c columns] [-d duplicate %] [-p presorted %] [-j jobs] [-r seed] [COLUMNS...]
+//
+// Without any sort columns a fixed suite of key layouts is run, each with
+// unique, mostly duplicate and mostly presorted keys. Columns of the types
+// N, L, F, D and T get values of that type, all others get words.
+
+struct BenchCase
+{
+	size_t Lines = 1000000;
+	size_t Columns = 4;
+	std::vector<ColIdentifier> Keys;
+	size_t DuplicatePercent = 0;
+	size_t PresortedPercent = 0;
+	size_t Jobs = 1;
+	size_t Seed = 1;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Input Generation
+//////////////////////////////////////////////////////////////////////////////
+
+class InputGenerator
+{
+public:
+	InputGenerator(const BenchCase& benchCase)
+		: m_case(benchCase), m_random(benchCase.Seed)
+	{
+		for (size_t col = 1; col <= m_case.Columns; ++col)
+		{
+			auto key = std::find_if(m_case.Keys.begin(), m_case.Keys.end(), [col](const ColIdentifier& id) { return id.Number == col; });
+			m_types.push_back(key != m_case.Keys.end() ? key->Type : 'S');
+		}
+	}
+
+	std::string Generate()
+	{
+		std::vector<std::vector<std::string>> rows(m_case.Lines);
+		std::uniform_int_distribution<size_t> percent(0, 99);
+		for (size_t i = 0; i < rows.size(); ++i)
+		{
+			// A duplicate takes all fields of an earlier line, not just the keys.
+			if (i > 0 && percent(m_random) < m_case.DuplicatePercent)
+			{
+				rows[i] = rows[std::uniform_int_distribution<size_t>(0, i - 1)(m_random)];
+				continue;
+			}
+
+			for (char type : m_types) rows[i].push_back(value(type));
+		}
+
+		if (m_case.PresortedPercent > 0 && !m_case.Keys.empty()) presort(rows);
+
+		std::string text;
+		for (auto& row : rows)
+		{
+			for (size_t col = 0; col < row.size(); ++col)
+			{
+				if (col != 0) text.push_back(' ');
+				text.append(row[col]);
+			}
+			text.push_back('\n');
+		}
+
+		return text;
+	}
+
+private:
+	std::string value(char type)
+	{
+		switch (type)
+		{
+		case 'N': return std::to_string(std::uniform_int_distribution<int32_t>(0, 1000000000)(m_random));
+		case 'L': return std::to_string(std::uniform_int_distribution<int64_t>()(m_random));
+		case 'F': return std::to_string(std::uniform_real_distribution<double>(-1e6, 1e6)(m_random));
+		case 'D': return decimal();
+		case 'T': return timestamp();
+		default: return word();
+		}
+	}
+
+	std::string decimal()
+	{
+		int64_t cents = std::uniform_int_distribution<int64_t>(-10000000, 10000000)(m_random);
+		std::string sign = cents < 0 ? "-" : "";
+		cents = std::abs(cents);
+
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%s%lld.%02lld", sign.c_str(), (long long)(cents / 100), (long long)(cents % 100));
+		return buffer;
+	}
+
+	// All timestamps have the same format, so their text order is their time order.
+	std::string timestamp()
+	{
+		auto number = [this](int min, int max) { return std::uniform_int_distribution<int>(min, max)(m_random); };
+
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02dZ", number(1970, 2037), number(1, 12), number(1, 28), number(0, 23), number(0, 59), number(0, 59));
+		return buffer;
+	}
+
+	std::string word()
+	{
+		std::uniform_int_distribution<int> letter('a', 'z');
+		std::string word(std::uniform_int_distribution<size_t>(6, 16)(m_random), ' ');
+		for (char& ch : word) ch = (char)letter(m_random);
+		return word;
+	}
+
+	// Orders the lines by the first sort column and then moves the lines that
+	// shouldn't be presorted to random places.
+	void presort(std::vector<std::vector<std::string>>& rows)
+	{
+		const ColIdentifier& key = m_case.Keys.front();
+		size_t col = key.Number - 1;
+		std::stable_sort(rows.begin(), rows.end(), [&key, col](const std::vector<std::string>& a, const std::vector<std::string>& b)
+		{
+			if (key.Type == 'N' || key.Type == 'L') return std::stoll(a[col]) < std::stoll(b[col]);
+			if (key.Type == 'F' || key.Type == 'D') return std::stod(a[col]) < std::stod(b[col]);
+			return a[col] < b[col];
+		});
+
+		std::uniform_int_distribution<size_t> percent(0, 99);
+		std::uniform_int_distribution<size_t> row(0, rows.size() - 1);
+		for (size_t i = 0; i < rows.size(); ++i)
+		{
+			if (percent(m_random) >= m_case.PresortedPercent) std::swap(rows[i], rows[row(m_random)]);
+		}
+	}
+
+	const BenchCase& m_case;
+	std::mt19937_64 m_random;
+	std::vector<char> m_types;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Measurement
+//////////////////////////////////////////////////////////////////////////////
+
+std::string keysToString(const std::vector<ColIdentifier>& keys)
+{
+	std::string str;
+	for (auto& key : keys)
+	{
+		if (!str.empty()) str.push_back(',');
+		str += key.Type + std::to_string(key.Number);
+	}
+	return str;
+}
+
+void printHeader()
+{
+	std::cout << std::left << std::setw(10) << "lines" << std::setw(6) << "cols" << std::setw(16) << "keys"
+		<< std::setw(6) << "dup%" << std::setw(9) << "sorted%" << std::setw(6) << "jobs"
+		<< std::right << std::setw(11) << "parse ms" << std::setw(11) << "keys ms" << std::setw(11) << "sort ms"
+		<< std::setw(11) << "output ms" << std::setw(13) << "lines/s" << std::setw(10) << "MB/s" << std::setw(10) << "peak MB" << '\n';
+}
+
+void runCase(const BenchCase& benchCase)
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::string input = InputGenerator(benchCase).Generate();
+	std::ofstream output("/dev/null", std::ios::binary);
+
+	PolySort sort(benchCase.Keys, std::cin, output);
+	sort.SetInputData(input);
+	sort.SetJobs(benchCase.Jobs);
+
+	std::vector<double> phases;
+	auto measure = [&phases](auto&& phase)
+	{
+		auto start = Clock::now();
+		bool ok = phase();
+		phases.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		return ok;
+	};
+
+	bool ok = measure([&]() { sort.ReadInput(); return true; })
+		&& measure([&]() { return sort.ExtractKeys(); })
+		&& measure([&]() { sort.SortLines(); return true; })
+		&& measure([&]() { return sort.WriteOutput(); });
+
+	if (!ok)
+	{
+		std::cout << sort.GetMessage() << std::endl;
+		return;
+	}
+
+	double totalSeconds = 0;
+	for (double phase : phases) totalSeconds += phase / 1000;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	std::cout << std::left << std::setw(10) << benchCase.Lines << std::setw(6) << benchCase.Columns << std::setw(16) << keysToString(benchCase.Keys)
+		<< std::setw(6) << benchCase.DuplicatePercent << std::setw(9) << benchCase.PresortedPercent << std::setw(6) << benchCase.Jobs
+		<< std::right << std::fixed << std::setprecision(1);
+	for (double phase : phases) std::cout << std::setw(11) << phase;
+	std::cout << std::setw(13) << std::setprecision(0) << benchCase.Lines / totalSeconds
+		<< std::setw(10) << std::setprecision(1) << input.size() / totalSeconds / (1 << 20)
+		<< std::setw(10) << usage.ru_maxrss / 1024.0 << std::endl;
+}
+
+// Runs the case in a child process, so that it starts from a small heap and
+// its peak RSS isn't shared with the other cases.
+void runIsolated(const BenchCase& benchCase)
+{
+	std::cout.flush();
+
+	pid_t child = fork();
+	if (child < 0)
+	{
+		runCase(benchCase);
+		return;
+	}
+
+	if (child == 0)
+	{
+		runCase(benchCase);
+		std::cout.flush();
+		_exit(0);
+	}
+
+	int status = 0;
+	waitpid(child, &status, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Entry Point
+//////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> args(argv + 1, argv + argc);
+	ArgParser parser(args, { 'n', 'c', 'd', 'p', 'j', 'r' });
+
+	if (!parser.Parse())
+	{
+		std::cerr << "error: chybne argumenty\n";
+		return 1;
+	}
+
+	BenchCase benchCase;
+	for (auto [option, value] : { std::pair{ 'n', &benchCase.Lines }, { 'c', &benchCase.Columns }, { 'd', &benchCase.DuplicatePercent },
+		{ 'p', &benchCase.PresortedPercent }, { 'j', &benchCase.Jobs }, { 'r', &benchCase.Seed } })
+	{
+		if (!parser.HasOptionValue(option)) continue;
+
+		auto parsed = strToInt(parser.GetOptionValue(option));
+		if (!parsed)
+		{
+			std::cerr << "error: chybne argumenty\n";
+			return 1;
+		}
+		*value = (size_t)*parsed;
+	}
+
+	std::vector<BenchCase> cases;
+	if (!parser.GetRequired().empty())
+	{
+		benchCase.Keys = parser.GetRequired();
+		cases.push_back(benchCase);
+	}
+	else
+	{
+		for (auto& keys : std::vector<std::vector<ColIdentifier>>{ { { 'N', 1 } }, { { 'S', 2 } }, { { 'S', 2 }, { 'N', 1 } }, { { 'N', 1 }, { 'S', 2 }, { 'N', 3 } } })
+		{
+			for (auto [duplicates, presorted] : { std::pair<size_t, size_t>{ 0, 0 }, { 90, 0 }, { 0, 95 } })
+			{
+				BenchCase suiteCase = benchCase;
+				suiteCase.Keys = keys;
+				suiteCase.DuplicatePercent = duplicates;
+				suiteCase.PresortedPercent = presorted;
+				cases.push_back(suiteCase);
+			}
+		}
+	}
+
+	for (auto& checkedCase : cases)
+	{
+		for (auto& key : checkedCase.Keys)
+		{
+			if (key.Number == 0 || key.Number > checkedCase.Columns)
+			{
+				std::cerr << "error: chybne argumenty\n";
+				return 1;
+			}
+		}
+	}
+
+	printHeader();
+	for (auto& suiteCase : cases) runIsolated(suiteCase);
+}